@@ -0,0 +1,117 @@
+--
+-- Benchmarks converting a large PNG to palette indices: every frame the image
+-- is loaded with love.graphics.newImage(), so the `update` phase reported by
+-- `love --bench N bench/imageload` is the time taken by one conversion.
+--
+-- The image is generated on the first run and written to the save directory.
+-- Its pixels are noise made of 250 distinct colors so that nearly every pixel
+-- needs a palette lookup.
+--
+
+local WIDTH, HEIGHT = 1024, 1024
+local COLORS = 250
+local FILENAME = "imageload.png"
+
+local image
+
+
+local crcTable = {}
+for i = 0, 255 do
+  local c = i
+  for _ = 1, 8 do
+    if c % 2 == 1 then
+      c = bit32.bxor(bit32.rshift(c, 1), 0xedb88320)
+    else
+      c = bit32.rshift(c, 1)
+    end
+  end
+  crcTable[i] = c
+end
+
+
+local function crc32(str)
+  local c = 0xffffffff
+  for i = 1, #str do
+    c = bit32.bxor(crcTable[bit32.band(bit32.bxor(c, str:byte(i)), 0xff)],
+                   bit32.rshift(c, 8))
+  end
+  return bit32.bnot(c)
+end
+
+
+local function adler32(str)
+  local a, b = 1, 0
+  for i = 1, #str do
+    a = (a + str:byte(i)) % 65521
+    b = (b + a) % 65521
+  end
+  return b * 65536 + a
+end
+
+
+local function u32(n)
+  return string.char(bit32.extract(n, 24, 8), bit32.extract(n, 16, 8),
+                     bit32.extract(n, 8, 8), bit32.extract(n, 0, 8))
+end
+
+
+local function chunk(kind, data)
+  return u32(#data) .. kind .. data .. u32(crc32(kind .. data))
+end
+
+
+local function encodePNG(width, height, pixel)
+  -- Encodes an 8bit RGB PNG whose zlib stream uses uncompressed blocks
+  local rows = {}
+  for y = 0, height - 1 do
+    local row = { "\0" }
+    for x = 0, width - 1 do
+      row[#row + 1] = pixel(x, y)
+    end
+    rows[#rows + 1] = table.concat(row)
+  end
+  local raw = table.concat(rows)
+  local blocks = { "\120\1" }
+  for i = 1, #raw, 65535 do
+    local block = raw:sub(i, i + 65534)
+    local last = (i + 65535 > #raw) and 1 or 0
+    blocks[#blocks + 1] = string.char(last,
+      #block % 256, math.floor(#block / 256),
+      255 - #block % 256, 255 - math.floor(#block / 256)) .. block
+  end
+  blocks[#blocks + 1] = u32(adler32(raw))
+  return "\137PNG\r\n\26\n" ..
+         chunk("IHDR", u32(width) .. u32(height) .. "\8\2\0\0\0") ..
+         chunk("IDAT", table.concat(blocks)) ..
+         chunk("IEND", "")
+end
+
+
+function love.load()
+  if not love.filesystem.exists(FILENAME) then
+    local colors = {}
+    for i = 1, COLORS do
+      colors[i] = string.char((i * 37) % 256, (i * 91) % 256, (i * 151) % 256)
+    end
+    local seed = 1
+    love.filesystem.write(FILENAME, encodePNG(WIDTH, HEIGHT, function()
+      seed = (seed * 1103515245 + 12345) % 2147483648
+      return colors[math.floor(seed / 65536) % COLORS + 1]
+    end))
+    collectgarbage()
+  end
+end
+
+
+function love.update(dt)
+  image = love.graphics.newImage(FILENAME)
+end
+
+
+function love.draw()
+  love.graphics.draw(image, 0, 0)
+  -- Free the image here so that its collection isn't timed as part of the
+  -- next update
+  image = nil
+  collectgarbage()
+end
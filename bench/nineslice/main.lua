@@ -0,0 +1,73 @@
+--
+-- Benchmarks drawing UI panels with love.graphics.drawNineSlice() against the
+-- same panels drawn in Lua with quads, as UI code without it would. The
+-- `draw` phase reported by `love --bench N bench/nineslice` is the time taken
+-- to draw PANELS panels with drawNineSlice(); passing `lua` after the game's
+-- directory draws them with the Lua implementation instead:
+--
+--   love --bench 600 bench/nineslice
+--   love --bench 600 bench/nineslice lua
+--
+
+local PANELS = 20
+local INSET = 8
+
+local panel
+local quads = {}
+local drawPanel
+
+
+local function quad(x, y, w, h)
+  local k = x .. "," .. y .. "," .. w .. "," .. h
+  quads[k] = quads[k] or love.graphics.newQuad(x, y, w, h)
+  return quads[k]
+end
+
+
+local function drawPanelLua(img, x, y, w, h)
+  -- Draws the corners once and tiles the edges and center between them
+  local g = love.graphics
+  local s = img:getWidth()
+  local m = s - INSET * 2
+  local r, b = x + w - INSET, y + h - INSET
+  g.draw(img, quad(0, 0, INSET, INSET), x, y)
+  g.draw(img, quad(s - INSET, 0, INSET, INSET), r, y)
+  g.draw(img, quad(0, s - INSET, INSET, INSET), x, b)
+  g.draw(img, quad(s - INSET, s - INSET, INSET, INSET), r, b)
+  for xx = x + INSET, r - 1, m do
+    local cw = math.min(m, r - xx)
+    g.draw(img, quad(INSET, 0, cw, INSET), xx, y)
+    g.draw(img, quad(INSET, s - INSET, cw, INSET), xx, b)
+    for yy = y + INSET, b - 1, m do
+      g.draw(img, quad(INSET, INSET, cw, math.min(m, b - yy)), xx, yy)
+    end
+  end
+  for yy = y + INSET, b - 1, m do
+    local ch = math.min(m, b - yy)
+    g.draw(img, quad(0, INSET, INSET, ch), x, yy)
+    g.draw(img, quad(s - INSET, INSET, INSET, ch), r, yy)
+  end
+end
+
+
+local function drawPanelC(img, x, y, w, h)
+  love.graphics.drawNineSlice(img, INSET, x, y, w, h, "tile")
+end
+
+
+function love.load(args)
+  panel = love.graphics.newCanvas(24, 24)
+  for y = 0, 23 do
+    for x = 0, 23 do
+      panel:setPixel(x, y, 100, 100, (x * y) % 256)
+    end
+  end
+  drawPanel = (args[2] == "lua") and drawPanelLua or drawPanelC
+end
+
+
+function love.draw()
+  for i = 0, PANELS - 1 do
+    drawPanel(panel, (i % 5) * 60 + 10, math.floor(i / 5) * 45 + 10, 50, 40)
+  end
+end
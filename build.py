@@ -13,6 +13,11 @@ DLIBS     = [ "m" ]
 DEFINES   = [ "DMT_ABORT_NULL", "LUA_COMPAT_ALL" ]
 INCLUDES  = [ "src", TEMPSRC_DIR ]
 
+# Used instead of the above by `build.py host`, which builds a native
+# executable with the headless backends for profiling and testing
+HOST_COMPILER = "gcc"
+HOST_BIN_NAME = "love"
+
 
 def fmt(fmt, var):
   for k in var:
@@ -34,8 +39,17 @@ def make_c_include(name, data):
 
 
 def main():
+  global COMPILER, BIN_NAME
   os.chdir(sys.path[0])
 
+  args = sys.argv[1:]
+  if args[:1] == ["host"]:
+    args = args[1:]
+    COMPILER = HOST_COMPILER
+    BIN_NAME = HOST_BIN_NAME
+    CFLAGS.remove("-s")
+    CFLAGS.append("-g")
+
   if not os.path.exists(BIN_DIR):
     os.makedirs(BIN_DIR)
 
@@ -61,7 +75,7 @@ def main():
       "outfile"   : BIN_DIR + "/" + BIN_NAME,
       "srcfiles"  : " ".join(cfiles),
       "libs"      : " ".join(map(lambda x: "-l" + x, DLIBS)),
-      "argv"      : " ".join(sys.argv[1:])
+      "argv"      : " ".join(args)
     })
 
   print "compiling..."
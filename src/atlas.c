@@ -0,0 +1,161 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lib/dmt/dmt.h"
+#include "atlas.h"
+
+/* The skyline is the list of segments making up the top edge of the packed
+ * area, each rect is placed resting on it */
+typedef struct {
+  int x, y, width;
+} segment_t;
+
+
+static int fitSegment(segment_t *sky, int n, int i, int w, int maxw, int *y) {
+  /* Gets the y a rect `w` wide would rest at with its left edge on the start
+   * of segment `i`. Returns 0 if it doesn't fit in the width */
+  int x = sky[i].x;
+  int left = w;
+  if (x + w > maxw) return 0;
+  *y = 0;
+  while (left > 0) {
+    if (i == n) return 0;
+    if (sky[i].y > *y) *y = sky[i].y;
+    left -= sky[i].width;
+    i++;
+  }
+  return 1;
+}
+
+
+static int addSegment(segment_t *sky, int n, int i, int x, int y, int w) {
+  /* Inserts a segment at index `i` covering `x` to `x + w`, shrinking or
+   * removing the segments it covers and merging equal neighbours. Returns the
+   * new number of segments */
+  memmove(sky + i + 1, sky + i, (n - i) * sizeof(*sky));
+  sky[i].x = x;
+  sky[i].y = y;
+  sky[i].width = w;
+  n++;
+  int j = i + 1;
+  while (j < n) {
+    int shrink = sky[j - 1].x + sky[j - 1].width - sky[j].x;
+    if (shrink <= 0) break;
+    sky[j].x += shrink;
+    sky[j].width -= shrink;
+    if (sky[j].width > 0) break;
+    memmove(sky + j, sky + j + 1, (n - j - 1) * sizeof(*sky));
+    n--;
+  }
+  for (j = 0; j < n - 1; j++) {
+    if (sky[j].y == sky[j + 1].y) {
+      sky[j].width += sky[j + 1].width;
+      memmove(sky + j + 1, sky + j + 2, (n - j - 2) * sizeof(*sky));
+      n--;
+      j--;
+    }
+  }
+  return n;
+}
+
+
+static void packWidth(atlas_rect_t *rects, const int *order, int count,
+                      int padding, int maxw, segment_t *sky
+) {
+  /* Packs the rects in the given order into an area `maxw` wide, placing each
+   * where it rests lowest */
+  int i, j, n = 1;
+  sky[0].x = 0;
+  sky[0].y = 0;
+  sky[0].width = maxw;
+  for (i = 0; i < count; i++) {
+    atlas_rect_t *r = &rects[order[i]];
+    int w = r->width + padding, h = r->height + padding;
+    int best = -1, bestY = 0, bestWidth = 0, y;
+    for (j = 0; j < n; j++) {
+      if (!fitSegment(sky, n, j, w, maxw, &y)) continue;
+      if (best < 0 || y < bestY || (y == bestY && sky[j].width < bestWidth)) {
+        best = j;
+        bestY = y;
+        bestWidth = sky[j].width;
+      }
+    }
+    r->x = sky[best].x;
+    r->y = bestY;
+    n = addSegment(sky, n, best, r->x, bestY + h, w);
+  }
+}
+
+
+static const atlas_rect_t *sortRects;
+
+static int compareRects(const void *a, const void *b) {
+  const atlas_rect_t *ra = &sortRects[*(const int*) a];
+  const atlas_rect_t *rb = &sortRects[*(const int*) b];
+  if (ra->height != rb->height) return rb->height - ra->height;
+  if (ra->width != rb->width) return rb->width - ra->width;
+  return *(const int*) a - *(const int*) b;
+}
+
+
+void atlas_pack(atlas_rect_t *rects, int count, int padding,
+                int *width, int *height
+) {
+  /* Sets the position of each rect so that none overlap, with at least
+   * `padding` pixels between them, using a skyline bottom-left packer on the
+   * rects sorted tallest first. A few widths upwards of the square root of
+   * the total area are tried and the one giving the smallest area is kept.
+   * The size of the packed area is stored in `width` and `height` */
+  int i, area = 0, widest = 1;
+  for (i = 0; i < count; i++) {
+    int w = rects[i].width + padding;
+    area += w * (rects[i].height + padding);
+    if (w > widest) widest = w;
+  }
+
+  int *order = dmt_malloc((count + 1) * sizeof(*order));
+  segment_t *sky = dmt_malloc((count + 2) * sizeof(*sky));
+  int *best = dmt_malloc((count + 1) * 2 * sizeof(*best));
+  for (i = 0; i < count; i++) order[i] = i;
+  sortRects = rects;
+  qsort(order, count, sizeof(*order), compareRects);
+
+  /* Try widths from the square root of the area upwards */
+  int tries, w = sqrt(area), bestArea = -1;
+  if (w < widest) w = widest;
+  for (tries = 0; tries < 8; tries++) {
+    packWidth(rects, order, count, padding, w, sky);
+    /* Get size without the padding after the last rects */
+    int pw = 0, ph = 0;
+    for (i = 0; i < count; i++) {
+      if (rects[i].x + rects[i].width > pw) pw = rects[i].x + rects[i].width;
+      if (rects[i].y + rects[i].height > ph) ph = rects[i].y + rects[i].height;
+    }
+    if (bestArea < 0 || pw * ph < bestArea) {
+      bestArea = pw * ph;
+      *width = pw;
+      *height = ph;
+      for (i = 0; i < count; i++) {
+        best[i * 2] = rects[i].x;
+        best[i * 2 + 1] = rects[i].y;
+      }
+    }
+    w += (w / 8 > 1) ? w / 8 : 1;
+  }
+  for (i = 0; i < count; i++) {
+    rects[i].x = best[i * 2];
+    rects[i].y = best[i * 2 + 1];
+  }
+
+  dmt_free(order);
+  dmt_free(sky);
+  dmt_free(best);
+}
@@ -0,0 +1,19 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef ATLAS_H
+#define ATLAS_H
+
+typedef struct {
+  int width, height;
+  int x, y;
+} atlas_rect_t;
+
+void atlas_pack(atlas_rect_t *rects, int count, int padding,
+                int *width, int *height);
+
+#endif
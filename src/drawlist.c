@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <string.h>
+
+#include "lib/dmt/dmt.h"
+#include "drawlist.h"
+
+
+void drawlist_init(drawlist_t *self) {
+  memset(self, 0, sizeof(*self));
+}
+
+
+void drawlist_deinit(drawlist_t *self) {
+  dmt_free(self->cmds);
+  dmt_free(self->text);
+}
+
+
+void drawlist_clear(drawlist_t *self) {
+  /* Empties the list, keeping its buffers for reuse */
+  self->count = 0;
+  self->textLen = 0;
+}
+
+
+drawcmd_t *drawlist_push(drawlist_t *self, int type) {
+  /* Appends a zeroed command of the given type and returns it, the pointer is
+   * only valid until the next push */
+  if (self->count == self->capacity) {
+    self->capacity = self->capacity ? self->capacity * 2 : 16;
+    self->cmds = dmt_realloc(self->cmds, self->capacity * sizeof(*self->cmds));
+  }
+  drawcmd_t *cmd = &self->cmds[self->count++];
+  memset(cmd, 0, sizeof(*cmd));
+  cmd->type = type;
+  return cmd;
+}
+
+
+int drawlist_pushText(drawlist_t *self, const char *str) {
+  /* Copies the string into the list's text buffer, returns its offset */
+  int len = strlen(str) + 1;
+  if (self->textLen + len > self->textCapacity) {
+    while (self->textLen + len > self->textCapacity) {
+      self->textCapacity = self->textCapacity ? self->textCapacity * 2 : 256;
+    }
+    self->text = dmt_realloc(self->text, self->textCapacity);
+  }
+  memcpy(self->text + self->textLen, str, len);
+  self->textLen += len;
+  return self->textLen - len;
+}
@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include "image.h"
+#include "font.h"
+
+enum {
+  DRAWLIST_IMAGE,
+  DRAWLIST_POINT,
+  DRAWLIST_LINE,
+  DRAWLIST_RECTANGLE,
+  DRAWLIST_CIRCLE,
+  DRAWLIST_PRINT,
+};
+
+typedef struct {
+  /* The color is kept as RGB and resolved to a palette index on replay so
+   * that it survives love.graphics.compactPalette() */
+  unsigned char type, blendMode, flag;
+  unsigned char color[3];
+  float x, y;
+  union {
+    struct {
+      image_t *image;
+      short sx, sy, sw, sh;
+      float r, kx, ky, ox, oy;
+    } image;
+    struct { int x2, y2; } line;
+    struct { int width, height; } rect;
+    struct { int radius; } circle;
+    struct { font_t *font; int text; } print;
+  } u;
+} drawcmd_t;
+
+typedef struct {
+  drawcmd_t *cmds;
+  int count, capacity;
+  char *text;
+  int textLen, textCapacity;
+} drawlist_t;
+
+void drawlist_init(drawlist_t *self);
+void drawlist_deinit(drawlist_t *self);
+void drawlist_clear(drawlist_t *self);
+drawcmd_t *drawlist_push(drawlist_t *self, int type);
+int drawlist_pushText(drawlist_t *self, const char *str);
+
+#endif
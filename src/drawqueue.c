@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <string.h>
+
+#include "lib/dmt/dmt.h"
+#include "drawqueue.h"
+
+
+static unsigned floatKey(float f) {
+  /* Maps the float to an unsigned int which sorts in the same order: the sign
+   * bit is flipped for positive values and all bits for negative values */
+  union { float f; unsigned u; } v;
+  v.f = f;
+  return (v.u & 0x80000000) ? ~v.u : (v.u | 0x80000000);
+}
+
+
+void drawqueue_init(drawqueue_t *self) {
+  memset(self, 0, sizeof(*self));
+}
+
+
+void drawqueue_deinit(drawqueue_t *self) {
+  dmt_free(self->entries);
+  dmt_free(self->keys);
+  dmt_free(self->tmp);
+}
+
+
+drawqueue_entry_t *drawqueue_push(drawqueue_t *self, float depth) {
+  /* Appends an entry with the given depth and returns it, the pointer is only
+   * valid until the next push. The queue's buffers only ever grow so that a
+   * queue refilled each frame stops allocating after the first few */
+  if (self->count == self->capacity) {
+    int n = self->capacity = self->capacity ? self->capacity * 2 : 64;
+    self->entries = dmt_realloc(self->entries, n * sizeof(*self->entries));
+    self->keys = dmt_realloc(self->keys, n * sizeof(*self->keys));
+    self->tmp = dmt_realloc(self->tmp, n * sizeof(*self->tmp));
+  }
+  drawqueue_entry_t *e = &self->entries[self->count++];
+  e->key = floatKey(depth);
+  return e;
+}
+
+
+const drawqueue_key_t *drawqueue_sort(drawqueue_t *self) {
+  /* Returns the entries' keys and indices sorted by depth, entries of equal
+   * depth keep the order they were pushed in. This is a LSD radix sort of one
+   * byte per pass; passes in which every key has the same byte are skipped */
+  drawqueue_key_t *src = self->keys, *dst = self->tmp, *t;
+  unsigned counts[4][256];
+  int i, pass, n = self->count;
+  memset(counts, 0, sizeof(counts));
+  for (i = 0; i < n; i++) {
+    unsigned k = self->entries[i].key;
+    src[i].key = k;
+    src[i].idx = i;
+    counts[0][k & 0xff]++;
+    counts[1][(k >> 8) & 0xff]++;
+    counts[2][(k >> 16) & 0xff]++;
+    counts[3][k >> 24]++;
+  }
+  for (pass = 0; pass < 4; pass++) {
+    unsigned *c = counts[pass];
+    int shift = pass * 8;
+    if (n == 0 || c[(src[0].key >> shift) & 0xff] == (unsigned) n) {
+      continue;
+    }
+    /* Turn counts into offsets and scatter */
+    unsigned sum = 0;
+    for (i = 0; i < 256; i++) {
+      unsigned tmp = c[i];
+      c[i] = sum;
+      sum += tmp;
+    }
+    for (i = 0; i < n; i++) {
+      dst[c[(src[i].key >> shift) & 0xff]++] = src[i];
+    }
+    t = src; src = dst; dst = t;
+  }
+  return src;
+}
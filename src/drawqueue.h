@@ -0,0 +1,35 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef DRAWQUEUE_H
+#define DRAWQUEUE_H
+
+#include "image.h"
+
+typedef struct {
+  unsigned key;
+  image_t *image;
+  short sx, sy, sw, sh;
+  int x, y, flip;
+} drawqueue_entry_t;
+
+typedef struct {
+  unsigned key, idx;
+} drawqueue_key_t;
+
+typedef struct {
+  drawqueue_entry_t *entries;
+  drawqueue_key_t *keys, *tmp;
+  int count, capacity;
+} drawqueue_t;
+
+void drawqueue_init(drawqueue_t *self);
+void drawqueue_deinit(drawqueue_t *self);
+drawqueue_entry_t *drawqueue_push(drawqueue_t *self, float depth);
+const drawqueue_key_t *drawqueue_sort(drawqueue_t *self);
+
+#endif
@@ -66,10 +66,126 @@ function love.boot()
     love.nogame()
   end
 
+  if love.benchFrames then
+    love.benchmark(love.benchFrames)
+  end
   love.run()
 end
 
 
+function love.benchmark(frames)
+  -- Times each phase of the next `frames` frames run by love.run() by wrapping
+  -- the functions it calls, then prints a report and exits. The report is
+  -- also printed if the game quits first, such as at the end of a replay
+  local phases = { "event", "update", "draw", "present", "frame" }
+  local times = {}
+  for _, name in ipairs(phases) do
+    times[name] = {}
+  end
+  local peakLua, peakAssets = 0, 0
+  local frame = 0
+  local start, updateStart, updateEnd, drawStart, presentStart
+  local getTime = love.timer.getTime
+
+  local function sampleMemory()
+    local lua = collectgarbage("count")
+    local total = love.system.getMemUsage()
+    peakLua = math.max(peakLua, lua)
+    peakAssets = math.max(peakAssets, total - lua)
+  end
+
+  local function percentile(t, p)
+    return t[math.max(1, math.ceil(#t * p))]
+  end
+
+  local function report()
+    print(string.format("bench: %d frames, dt %.6f", frame,
+                        love.timer.getDelta()))
+    if frame == 0 then
+      return
+    end
+    print(string.format("%-10s %9s %9s %9s %9s %9s %9s", "phase (ms)",
+                        "mean", "min", "p50", "p90", "p99", "max"))
+    for _, name in ipairs(phases) do
+      local t = times[name]
+      local sum = 0
+      for _, v in ipairs(t) do sum = sum + v end
+      table.sort(t)
+      print(string.format("%-10s %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f", name,
+                          sum / #t * 1000, t[1] * 1000,
+                          percentile(t, .5) * 1000, percentile(t, .9) * 1000,
+                          percentile(t, .99) * 1000, t[#t] * 1000))
+    end
+    print(string.format("peak memory: lua %.1fkb, assets %.1fkb",
+                        peakLua, peakAssets))
+  end
+
+  -- Wrap the callbacks, which the game may replace at any time, at the start
+  -- of each frame
+  local update, draw
+  local function wrappedUpdate(...)
+    updateStart = getTime()
+    update(...)
+    updateEnd = getTime()
+  end
+  local function wrappedDraw(...)
+    drawStart = getTime()
+    draw(...)
+  end
+
+  local pump, poll = love.event.pump, love.event.poll
+  love.event.pump = function()
+    start = getTime()
+    pump()
+    updateStart, updateEnd, drawStart = nil, nil, nil
+    if love.update ~= wrappedUpdate then
+      update = love.update or function() end
+      love.update = wrappedUpdate
+    end
+    if love.draw ~= wrappedDraw then
+      draw = love.draw or function() end
+      love.draw = wrappedDraw
+    end
+  end
+
+  love.event.poll = function()
+    local name, a, b, c, d = poll()
+    if name == "quit" then
+      report()
+      os.exit(a)
+    end
+    return name, a, b, c, d
+  end
+
+  local present = love.graphics.present
+  love.graphics.present = function(...)
+    presentStart = getTime()
+    present(...)
+    local now = getTime()
+    if not start then
+      return
+    end
+    -- Phases which didn't run take no time
+    updateStart = updateStart or presentStart
+    updateEnd = updateEnd or updateStart
+    drawStart = drawStart or updateEnd
+    table.insert(times.event, updateStart - start)
+    table.insert(times.update, updateEnd - updateStart)
+    table.insert(times.draw, presentStart - drawStart)
+    table.insert(times.present, now - presentStart)
+    table.insert(times.frame, now - start)
+    sampleMemory()
+    frame = frame + 1
+    if frame == frames then
+      report()
+      os.exit(0)
+    end
+  end
+
+  sampleMemory()
+end
+
+
 function love.run()
   -- Prepare arguments
   local args = {}
@@ -101,6 +217,7 @@ function love.run()
     local dt = love.timer.getDelta()
     if love.update then love.update(dt) end
     -- Draw
+    love.graphics.origin()
     love.graphics.clear()
     if love.draw then love.draw() end
     love.graphics.present()
@@ -117,6 +234,13 @@ function love.errhand(msg)
   end
   local str = table.concat(err, "\n")
 
+  -- A benchmark can't be interacted with and must not report the error screen
+  -- as frames, so print the error and fail instead
+  if love.benchFrames then
+    io.stderr:write(str, "\n")
+    os.exit(1)
+  end
+
   -- Init error state
   love.graphics.reset()
   pcall(love.graphics.setBackgroundColor, 89, 157, 220)
@@ -14,11 +14,35 @@
 #define BUFFER_SIZE 256
 #define BUFFER_MASK (BUFFER_SIZE - 1)
 
+#define LOG_MAGIC   "LDIN"
+#define LOG_VERSION 1
+#define MAX_KEYS    128
+#define MAX_KEYLEN  16
+
+enum { MODE_LIVE, MODE_RECORD, MODE_REPLAY };
+
 static struct {
   event_t buffer[BUFFER_SIZE];
   unsigned writei, readi;
 } events;
 
+/* An input log starts with LOG_MAGIC and LOG_VERSION followed by a record for
+ * each device event, its type as a byte and then its fields. Each frame's
+ * events are followed by an EVENT_NULL record holding the frame's delta time
+ * as a 32bit float, so an event's frame number is the number of EVENT_NULL
+ * records before it. Numbers are little-endian */
+static struct {
+  int mode;
+  FILE *fp;
+  int next;
+  /* Input state of the replay */
+  char keys[MAX_KEYS][MAX_KEYLEN];
+  char keyStates[MAX_KEYS];
+  int nkeys;
+  int mouseX, mouseY;
+  char mouseStates[MOUSE_BUTTON_MAX];
+} session;
+
 
 const char* event_typestr(int type) {
   switch (type) {
@@ -39,9 +63,196 @@ void event_push(event_t *e) {
 }
 
 
+static void writeByte(int v) {
+  fputc(v & 0xff, session.fp);
+}
+
+
+static void writeShort(int v) {
+  writeByte(v);
+  writeByte(v >> 8);
+}
+
+
+static void writeString(const char *str) {
+  int len = strlen(str);
+  if (len > 255) len = 255;
+  writeByte(len);
+  fwrite(str, 1, len, session.fp);
+}
+
+
+static void writeFloat(float f) {
+  union { float f; unsigned u; } v = { f };
+  writeShort(v.u);
+  writeShort(v.u >> 16);
+}
+
+
+static int readByte(void) {
+  return fgetc(session.fp) & 0xff;
+}
+
+
+static int readShort(void) {
+  int v = readByte();
+  return (short) (v | readByte() << 8);
+}
+
+
+static float readFloat(void) {
+  union { float f; unsigned u; } v;
+  v.u = readShort() & 0xffff;
+  v.u |= (unsigned) readShort() << 16;
+  return v.f;
+}
+
+
+static void readString(char *buf, int size) {
+  int i, len = readByte();
+  for (i = 0; i < len; i++) {
+    int c = readByte();
+    if (i < size - 1) buf[i] = c;
+  }
+  buf[len < size - 1 ? len : size - 1] = '\0';
+}
+
+
+static void recordEvent(event_t *e) {
+  switch (e->type) {
+    case EVENT_KEYBOARD_PRESSED:
+    case EVENT_KEYBOARD_RELEASED:
+      writeByte(e->type);
+      writeByte(e->keyboard.isrepeat);
+      writeString(e->keyboard.key);
+      break;
+
+    case EVENT_KEYBOARD_TEXTINPUT:
+      writeByte(e->type);
+      writeString(e->keyboard.text);
+      break;
+
+    case EVENT_MOUSE_MOVED:
+      writeByte(e->type);
+      writeShort(e->mouse.x);
+      writeShort(e->mouse.y);
+      writeShort(e->mouse.dx);
+      writeShort(e->mouse.dy);
+      break;
+
+    case EVENT_MOUSE_PRESSED:
+    case EVENT_MOUSE_RELEASED:
+      writeByte(e->type);
+      writeShort(e->mouse.x);
+      writeShort(e->mouse.y);
+      writeByte(e->mouse.button);
+      break;
+  }
+}
+
+
+static int replayKey(const char *name) {
+  /* Returns the index of the key's state, adding the key if it's new. Events
+   * point at the stored name, which stays valid until the replay ends */
+  int i;
+  for (i = 0; i < session.nkeys; i++) {
+    if (!strcmp(session.keys[i], name)) {
+      return i;
+    }
+  }
+  if (session.nkeys == MAX_KEYS) {
+    return -1;
+  }
+  strcpy(session.keys[session.nkeys], name);
+  return session.nkeys++;
+}
+
+
+static void replayFrame(void) {
+  /* Pushes the events of the log's current frame, or a quit event at the end
+   * of the log */
+  char name[MAX_KEYLEN];
+  event_t e;
+  int k;
+  while (session.next != EVENT_NULL) {
+    if (session.next == EOF) {
+      e.type = EVENT_QUIT;
+      e.quit.status = 0;
+      event_push(&e);
+      session.next = EVENT_NULL;
+      fclose(session.fp);
+      session.fp = NULL;
+      return;
+    }
+    memset(&e, 0, sizeof(e));
+    e.type = session.next;
+    switch (e.type) {
+      case EVENT_KEYBOARD_PRESSED:
+      case EVENT_KEYBOARD_RELEASED:
+        e.keyboard.isrepeat = readByte();
+        readString(name, sizeof(name));
+        k = replayKey(name);
+        if (k < 0) {
+          e.type = EVENT_NULL;
+          break;
+        }
+        e.keyboard.key = session.keys[k];
+        session.keyStates[k] = e.type == EVENT_KEYBOARD_PRESSED;
+        break;
+
+      case EVENT_KEYBOARD_TEXTINPUT:
+        readString(e.keyboard.text, sizeof(e.keyboard.text));
+        break;
+
+      case EVENT_MOUSE_MOVED:
+        e.mouse.x = session.mouseX = readShort();
+        e.mouse.y = session.mouseY = readShort();
+        e.mouse.dx = readShort();
+        e.mouse.dy = readShort();
+        break;
+
+      case EVENT_MOUSE_PRESSED:
+      case EVENT_MOUSE_RELEASED:
+        e.mouse.x = readShort();
+        e.mouse.y = readShort();
+        e.mouse.button = readByte() % MOUSE_BUTTON_MAX;
+        session.mouseStates[e.mouse.button] = e.type == EVENT_MOUSE_PRESSED;
+        break;
+
+      default:
+        /* Unknown record, the rest of the log can't be read */
+        session.next = EOF;
+        continue;
+    }
+    /* Drop an event cut short by the end of the log */
+    if (e.type != EVENT_NULL && !feof(session.fp)) {
+      event_push(&e);
+    }
+    session.next = fgetc(session.fp);
+  }
+}
+
+
 void event_pump(void) {
+  unsigned i = events.writei;
   keyboard_update();
   mouse_update();
+  switch (session.mode) {
+    case MODE_RECORD:
+      for (; i != events.writei; i++) {
+        recordEvent(&events.buffer[i & BUFFER_MASK]);
+      }
+      break;
+
+    case MODE_REPLAY:
+      /* The devices are still updated to keep their buffers drained, but their
+       * events are replaced by those of the log */
+      events.writei = i;
+      if (session.fp) {
+        replayFrame();
+      }
+      break;
+  }
 }
 
 
@@ -52,3 +263,105 @@ int event_poll(event_t *e) {
   }
   return 0;
 }
+
+
+int event_record(const char *filename) {
+  /* Starts writing the device events of each frame and the frame's delta time
+   * to the file. Returns -1 if the file can't be opened */
+  event_deinit();
+  session.fp = fopen(filename, "wb");
+  if (!session.fp) {
+    return -1;
+  }
+  fwrite(LOG_MAGIC, 1, strlen(LOG_MAGIC), session.fp);
+  writeByte(LOG_VERSION);
+  session.mode = MODE_RECORD;
+  return 0;
+}
+
+
+int event_replay(const char *filename) {
+  /* Starts replacing device events and delta times with those of the log,
+   * pushing a quit event when it ends. If `filename` is NULL device events
+   * are ignored and delta times are left as they are. Returns -1 if the file
+   * can't be opened or isn't an input log */
+  char magic[4];
+  event_deinit();
+  if (filename) {
+    session.fp = fopen(filename, "rb");
+    if (!session.fp) {
+      return -1;
+    }
+    if (fread(magic, 1, 4, session.fp) != 4 ||
+        memcmp(magic, LOG_MAGIC, 4) || readByte() != LOG_VERSION
+    ) {
+      event_deinit();
+      return -1;
+    }
+    session.next = fgetc(session.fp);
+  }
+  session.mode = MODE_REPLAY;
+  return 0;
+}
+
+
+void event_deinit(void) {
+  if (session.fp) {
+    fclose(session.fp);
+  }
+  memset(&session, 0, sizeof(session));
+}
+
+
+double event_step(double dt) {
+  /* Called with each frame's delta time; returns the delta time the frame
+   * should use */
+  switch (session.mode) {
+    case MODE_RECORD:
+      /* The recorded session uses the same precision as the log so that the
+       * replay matches it exactly */
+      writeByte(EVENT_NULL);
+      writeFloat(dt);
+      return (float) dt;
+
+    case MODE_REPLAY:
+      if (session.fp && session.next == EVENT_NULL) {
+        float f = readFloat();
+        if (!feof(session.fp)) dt = f;
+        session.next = fgetc(session.fp);
+      }
+      break;
+  }
+  return dt;
+}
+
+
+int event_isReplaying(void) {
+  return session.mode == MODE_REPLAY;
+}
+
+
+int event_isKeyDown(const char *key) {
+  int i;
+  for (i = 0; i < session.nkeys; i++) {
+    if (!strcmp(session.keys[i], key)) {
+      return session.keyStates[i];
+    }
+  }
+  return 0;
+}
+
+
+int event_isMouseDown(int button) {
+  return session.mouseStates[button];
+}
+
+
+int event_getMouseX(void) {
+  return session.mouseX;
+}
+
+
+int event_getMouseY(void) {
+  return session.mouseY;
+}
@@ -49,4 +49,14 @@ void event_push(event_t *e);
 void event_pump(void);
 int event_poll(event_t *e);
 
+int event_record(const char *filename);
+int event_replay(const char *filename);
+void event_deinit(void);
+double event_step(double dt);
+int event_isReplaying(void);
+int event_isKeyDown(const char *key);
+int event_isMouseDown(int button);
+int event_getMouseX(void);
+int event_getMouseY(void);
+
 #endif
@@ -112,8 +112,9 @@ void font_deinit(font_t *self) {
 
 extern int image_blendMode;
 extern int image_flip;
+extern const pixel_t *image_remap;
 
-void font_blit(font_t *self, pixel_t *buf, int bufw, int bufh,
+void font_blit(font_t *self, pixel_t *buf, int bufw, int bufh, int bufs,
                const char *str, int dx, int dy
 ) {
   const char *p = str;
@@ -122,8 +123,10 @@ void font_blit(font_t *self, pixel_t *buf, int bufw, int bufh,
 
   int oldBlendMode = image_blendMode;
   int oldFlip = image_flip;
+  const pixel_t *oldRemap = image_remap;
   image_blendMode = IMAGE_COLOR;
   image_flip = 0;
+  image_remap = NULL;
 
   while (*p) {
     if (*p == '\n') {
@@ -133,7 +136,7 @@ void font_blit(font_t *self, pixel_t *buf, int bufw, int bufh,
       stbtt_bakedchar *g = &self->glyphs[(int) (*p & 127)];
       int w = g->x1 - g->x0;
       int h = g->y1 - g->y0;
-      image_blit(&self->image, buf, bufw, bufh,
+      image_blit(&self->image, buf, bufw, bufh, bufs,
                  x + g->xoff, y + g->yoff, g->x0, g->y0, w, h);
       x += g->xadvance;
     }
@@ -142,4 +145,5 @@ void font_blit(font_t *self, pixel_t *buf, int bufw, int bufh,
 
   image_blendMode = oldBlendMode;
   image_flip = oldFlip;
+  image_remap = oldRemap;
 }
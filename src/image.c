@@ -8,16 +8,42 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "lib/dmt/dmt.h"
 #include "lib/stb/stb_image.h"
 #include "filesystem.h"
 #include "image.h"
 #include "palette.h"
+#include "quantize.h"
 
 int image_blendMode = IMAGE_NORMAL;
 int image_flip = 0;
 unsigned int image_color = 0x0f0f0f0f;
+const pixel_t *image_remap = NULL;
+
+/* All live images are kept in a list so that their pixels can be found when
+ * the palette is compacted */
+image_t *image_list;
+
+
+static void linkImage(image_t *self) {
+  self->prev = NULL;
+  self->next = image_list;
+  if (image_list) image_list->prev = self;
+  image_list = self;
+}
+
+
+static void unlinkImage(image_t *self) {
+  if (self->prev) {
+    self->prev->next = self->next;
+  } else if (image_list == self) {
+    image_list = self->next;
+  }
+  if (self->next) self->next->prev = self->prev;
+  self->prev = self->next = NULL;
+}
 
 
 void image_setBlendMode(int mode) {
@@ -32,10 +58,25 @@ void image_setFlip(int mode) {
   image_flip = !!mode;
 }
 
+void image_setRemap(const pixel_t *remap) {
+  /* Sets the table each source pixel is passed through when blitting, or
+   * disables remapping if `remap` is NULL. remap[0] must be 0 */
+  image_remap = remap;
+}
+
 
 
 const char *image_init(image_t *self, const char *filename) {
-  /* Loads an image file into the struct and inits the mask */
+  return image_initQuantized(self, filename, 0, 0);
+}
+
+
+const char *image_initQuantized(image_t *self, const char *filename,
+                                int colors, int dither
+) {
+  /* Loads an image file into the struct and inits the mask. If `colors` is
+   * larger than 0 the image's colors are first reduced so that it takes at
+   * most that many new palette slots, `dither` enables ordered dithering */
   const char *errmsg = NULL;
   void *filedata = NULL;
   unsigned char *data32 = NULL;
@@ -65,22 +106,35 @@ const char *image_init(image_t *self, const char *filename) {
   int sz = width * height;
   self->width = width;
   self->height = height;
+  self->stride = width;
   self->data = dmt_malloc(sz);
 
   /* Load pixels into struct, converting 32bit to 8bit paletted */
   int i;
-  for (i = 0; i < width * height; i++) {
-    unsigned char *p = data32 + i * 4;
-    int r = p[0];
-    int g = p[1];
-    int b = p[2];
-    int a = p[3];
-    int idx = palette_colorToIdx(r, g, b);
-    if (idx < 0) {
-      errmsg = "color palette exhausted: use fewer unique colors";
+  if (colors > 0) {
+    errmsg = quantize_image(self->data, data32, width, height, colors, dither);
+    if (errmsg) {
       goto fail;
     }
-    self->data[i] = (a >= 127) ? idx : 0;
+  } else {
+    /* Neighbouring pixels are often the same color, so the last color's idx
+     * is kept to skip the palette lookup */
+    unsigned lastColor = 0;
+    int idx = -1;
+    for (i = 0; i < width * height; i++) {
+      unsigned char *p = data32 + i * 4;
+      unsigned color = p[0] | (p[1] << 8) | (p[2] << 16);
+      int a = p[3];
+      if (color != lastColor || idx < 0) {
+        idx = palette_colorToIdx(p[0], p[1], p[2]);
+        if (idx < 0) {
+          errmsg = "color palette exhausted: use fewer unique colors";
+          goto fail;
+        }
+        lastColor = color;
+      }
+      self->data[i] = (a >= 127) ? idx : 0;
+    }
   }
 
   /* Init mask */
@@ -93,6 +147,7 @@ const char *image_init(image_t *self, const char *filename) {
   free(data32);
   data32 = NULL;
 
+  linkImage(self);
   return NULL;
 
 fail:
@@ -109,14 +164,39 @@ void image_initBlank(image_t *self, int width, int height) {
   self->data = dmt_calloc(1, width * height);
   self->width = width;
   self->height = height;
+  self->stride = width;
   /* Init mask */
   self->mask = dmt_calloc(1, width * height);
+  linkImage(self);
+}
+
+
+void image_initView(image_t *self, image_t *parent,
+                    int x, int y, int width, int height
+) {
+  /* Inits the image as a view of the rect of `parent`, clipped to its bounds,
+   * sharing the parent's pixels rather than copying them. The parent must
+   * outlive the view */
+  memset(self, 0, sizeof(*self));
+  if (x < 0) { width += x; x = 0; }
+  if (y < 0) { height += y; y = 0; }
+  if (x + width > parent->width) { width = parent->width - x; }
+  if (y + height > parent->height) { height = parent->height - y; }
+  if (width <= 0 || height <= 0) { width = height = 0; x = y = 0; }
+  self->data = parent->data + x + y * parent->stride;
+  self->mask = parent->mask + x + y * parent->stride;
+  self->width = width;
+  self->height = height;
+  self->stride = parent->stride;
+  self->parent = parent;
 }
 
 
-void image_blit(image_t *self, pixel_t *buf, int bufw, int bufh,
+void image_blit(image_t *self, pixel_t *buf, int bufw, int bufh, int bufs,
                 int dx, int dy, int sx, int sy, int sw, int sh
 ) {
+  /* Blits the source rect to the buffer of `bufw` by `bufh` pixels whose rows
+   * are `bufs` pixels apart */
   int diff;
 
   /* Clip to source buffer */
@@ -140,13 +220,16 @@ void image_blit(image_t *self, pixel_t *buf, int bufw, int bufh,
   if (sw <= 0 || sh <= 0) return;
 
   /* Blit */
-  #define BLIT_LOOP_NORMAL(func)\
+  #define READ_DIRECT(i)  self->data[i]
+  #define READ_REMAP(i)   remap[self->data[i]]
+
+  #define BLIT_LOOP_NORMAL(func, read)\
     {\
       int x, y;\
-      int srci = sx + sy * self->width;\
-      int dsti = dx + dy * bufw;\
-      int srcrowdiff = self->width - sw;\
-      int dstrowdiff = bufw - sw;\
+      int srci = sx + sy * self->stride;\
+      int dsti = dx + dy * bufs;\
+      int srcrowdiff = self->stride - sw;\
+      int dstrowdiff = bufs - sw;\
       int sw32 = sw - (sw & 3);\
       for (y = 0; y < sh; y++) {\
         for (x = 0; x < sw32; x += 4) {\
@@ -166,16 +249,34 @@ void image_blit(image_t *self, pixel_t *buf, int bufw, int bufh,
       }\
     }
 
-  #define BLIT_LOOP_FLIPPED(func)\
+  #define BLIT_LOOP_BYTES(func, read)\
     {\
       int x, y;\
-      int srci = sx + sy * self->width + sw - 1;\
-      int dsti = dx + dy * bufw;\
-      int srcrowdiff = self->width + sw;\
-      int dstrowdiff = bufw - sw;\
+      int srci = sx + sy * self->stride;\
+      int dsti = dx + dy * bufs;\
+      int srcrowdiff = self->stride - sw;\
+      int dstrowdiff = bufs - sw;\
       for (y = 0; y < sh; y++) {\
         for (x = 0; x < sw; x++) {\
-          func(buf[dsti], self->data[srci], self->mask[srci])\
+          func(buf[dsti], read(srci), self->mask[srci])\
+          srci++;\
+          dsti++;\
+        }\
+        srci += srcrowdiff;\
+        dsti += dstrowdiff;\
+      }\
+    }
+
+  #define BLIT_LOOP_FLIPPED(func, read)\
+    {\
+      int x, y;\
+      int srci = sx + sy * self->stride + sw - 1;\
+      int dsti = dx + dy * bufs;\
+      int srcrowdiff = self->stride + sw;\
+      int dstrowdiff = bufs - sw;\
+      for (y = 0; y < sh; y++) {\
+        for (x = 0; x < sw; x++) {\
+          func(buf[dsti], read(srci), self->mask[srci])\
           srci--;\
           dsti++;\
         }\
@@ -188,6 +289,9 @@ void image_blit(image_t *self, pixel_t *buf, int bufw, int bufh,
     (dst) &= (msk);\
     (dst) |= (src);
 
+  #define BLIT_FAST(dst, src, msk)\
+    (dst) = (src);
+
   #define BLIT_AND(dst, src, msk)\
     (dst) &= (src);
 
@@ -198,36 +302,656 @@ void image_blit(image_t *self, pixel_t *buf, int bufw, int bufh,
     (dst) &= (msk);\
     (dst) |= ~(msk) & image_color;
 
-  #define BLIT(blit_loop)\
+  #define BLIT_TABLE(dst, src, msk)\
+    if (!(msk)) (dst) = table[((src) << 8) | (dst)];
+
+  #define BLIT(blit_loop, read)\
     switch (image_blendMode) {\
       default:\
-      case IMAGE_NORMAL : blit_loop(BLIT_NORMAL)  break;\
-      case IMAGE_AND    : blit_loop(BLIT_AND)     break;\
-      case IMAGE_OR     : blit_loop(BLIT_OR)      break;\
-      case IMAGE_COLOR  : blit_loop(BLIT_COLOR)   break;\
+      case IMAGE_NORMAL   : blit_loop(BLIT_NORMAL, read)  break;\
+      case IMAGE_FAST     : blit_loop(BLIT_FAST, read)    break;\
+      case IMAGE_AND      : blit_loop(BLIT_AND, read)     break;\
+      case IMAGE_OR       : blit_loop(BLIT_OR, read)      break;\
+      case IMAGE_COLOR    : blit_loop(BLIT_COLOR, read)   break;\
+      case IMAGE_ALPHA    :\
+      case IMAGE_ADD      :\
+      case IMAGE_MULTIPLY : blit_loop(BLIT_TABLE, read)   break;\
     }\
 
-  if (!image_flip) {
-    if (image_blendMode == IMAGE_FAST) {
-      int y;
-      int srci = sx + sy * self->width;
-      int dsti = dx + dy * bufw;
-      for (y = 0; y < sh; y++) {
-        memcpy(buf + dsti, self->data + srci, sw);
-        srci += self->width;
-        dsti += bufw;
+  const pixel_t *remap = image_remap;
+  const pixel_t *table = NULL;
+  if (image_blendMode >= IMAGE_ALPHA) {
+    /* Translucent modes blend each pixel with a single blend table lookup */
+    table = palette_getBlendTable(
+      PALETTE_BLEND_ALPHA + image_blendMode - IMAGE_ALPHA);
+  }
+
+  if (!image_flip && !remap && image_blendMode == IMAGE_FAST) {
+    int y;
+    int srci = sx + sy * self->stride;
+    int dsti = dx + dy * bufs;
+    for (y = 0; y < sh; y++) {
+      memcpy(buf + dsti, self->data + srci, sw);
+      srci += self->stride;
+      dsti += bufs;
+    }
+  } else if (!image_flip && !remap && !table) {
+    BLIT(BLIT_LOOP_NORMAL, READ_DIRECT);
+  } else if (!image_flip) {
+    /* Remapped and translucent pixels are handled a byte at a time */
+    if (remap) {
+      BLIT(BLIT_LOOP_BYTES, READ_REMAP);
+    } else {
+      BLIT(BLIT_LOOP_BYTES, READ_DIRECT);
+    }
+  } else {
+    if (remap) {
+      BLIT(BLIT_LOOP_FLIPPED, READ_REMAP);
+    } else {
+      BLIT(BLIT_LOOP_FLIPPED, READ_DIRECT);
+    }
+  }
+
+}
+
+
+typedef struct {
+  double dx, dy, c, s, kx, ky, ox, oy;
+  int x0, x1, dudx, dvdx, uw, vh;
+} affine_t;
+
+
+static long long floorDiv(long long a, long long b) {
+  return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+
+static void clampSpan(long long *lo, long long *hi, long long p, int dp,
+                      int max
+) {
+  /* Narrows the [lo, hi] range of steps k for which 0 <= p + k * dp < max */
+  if (dp == 0) {
+    if (p < 0 || p >= max) *hi = -1;
+  } else if (dp > 0) {
+    long long a = -floorDiv(p, dp);
+    long long b = floorDiv(max - 1 - p, dp);
+    if (a > *lo) *lo = a;
+    if (b < *hi) *hi = b;
+  } else {
+    long long a = -floorDiv(max - 1 - p, -dp);
+    long long b = floorDiv(p, -dp);
+    if (a > *lo) *lo = a;
+    if (b < *hi) *hi = b;
+  }
+}
+
+
+static int affineRow(const affine_t *a, int y, int *u, int *v, int *first) {
+  /* Gets the 16.16 source position of the first pixel of the row whose
+   * center maps inside the source rect, returns the number of such pixels */
+  double px = a->x0 + 0.5 - a->dx;
+  double py = y + 0.5 - a->dy;
+  long long u0 = floor(((px * a->c + py * a->s) / a->kx + a->ox) * 65536.);
+  long long v0 = floor(((py * a->c - px * a->s) / a->ky + a->oy) * 65536.);
+  long long lo = 0, hi = a->x1 - a->x0 - 1;
+  clampSpan(&lo, &hi, u0, a->dudx, a->uw);
+  clampSpan(&lo, &hi, v0, a->dvdx, a->vh);
+  if (hi < lo) return 0;
+  *first = lo;
+  *u = u0 + lo * a->dudx;
+  *v = v0 + lo * a->dvdx;
+  return hi - lo + 1;
+}
+
+
+void image_blitTransform(image_t *self, pixel_t *buf, int bufw, int bufh,
+                         int bufs, double dx, double dy,
+                         int sx, int sy, int sw, int sh,
+                         double r, double kx, double ky, double ox, double oy
+) {
+  /* Blits the source rect rotated by `r` radians and scaled by `kx`, `ky`
+   * around its origin `ox`, `oy`, which is placed at `dx`, `dy`. Each
+   * destination pixel inside the transformed rect's bounding box samples the
+   * source by stepping 16.16 fixed point coordinates along its row */
+  int x, y, diff;
+
+  /* Clip to source buffer */
+  if (sx < 0) { sw += sx; sx = 0; }
+  if (sy < 0) { sh += sy; sy = 0; }
+  if ((diff = (sx + sw) - self->width) > 0) { sw -= diff; }
+  if ((diff = (sy + sh) - self->height) > 0) { sh -= diff; }
+  if (sw <= 0 || sh <= 0) return;
+  /* Scales this small would overflow the fixed point steps and draw nothing */
+  if (fabs(kx) < 1. / 1024 || fabs(ky) < 1. / 1024) return;
+
+  const pixel_t *remap = image_remap;
+  const pixel_t *table = NULL;
+  if (image_blendMode >= IMAGE_ALPHA) {
+    table = palette_getBlendTable(
+      PALETTE_BLEND_ALPHA + image_blendMode - IMAGE_ALPHA);
+  }
+
+  if (r == 0 && kx >= 1 && ky >= 1 && kx == (int) kx && ky == (int) ky) {
+    /* Fast path for axis-aligned integer scales: each source pixel is
+     * repeated `kx` times along the row and each row `ky` times */
+    int kxi = kx, kyi = ky;
+    int left = ceil(dx - ox * kx - 0.5);
+    int top = ceil(dy - oy * ky - 0.5);
+    int xa = (left < 0) ? 0 : left;
+    int ya = (top < 0) ? 0 : top;
+    int xb = left + sw * kxi;
+    int yb = top + sh * kyi;
+    if (xb > bufw) xb = bufw;
+    if (yb > bufh) yb = bufh;
+    if (xa >= xb || ya >= yb) return;
+
+    #define SCALED_LOOP(func, read)\
+      for (y = ya; y < yb; y++) {\
+        int row = (sy + (y - top) / kyi) * self->stride + sx;\
+        int col = (xa - left) / kxi;\
+        int rep = (xa - left) % kxi;\
+        pixel_t *d = buf + xa + y * bufs;\
+        for (x = xa; x < xb; x++) {\
+          int srci = row + col;\
+          func(*d, read(srci), self->mask[srci])\
+          d++;\
+          if (++rep == kxi) { rep = 0; col++; }\
+        }\
       }
+
+    if (remap) {
+      BLIT(SCALED_LOOP, READ_REMAP);
     } else {
-      BLIT(BLIT_LOOP_NORMAL);
+      BLIT(SCALED_LOOP, READ_DIRECT);
+    }
+    return;
+  }
+
+  /* Get bounding box of the transformed rect, clipped to the destination */
+  affine_t a;
+  a.dx = dx; a.dy = dy;
+  a.c = cos(r); a.s = sin(r);
+  a.kx = kx; a.ky = ky;
+  a.ox = ox; a.oy = oy;
+  double minx = 1e9, miny = 1e9, maxx = -1e9, maxy = -1e9;
+  int i;
+  for (i = 0; i < 4; i++) {
+    double lx = ((i & 1) ? sw : 0) - ox;
+    double ly = ((i & 2) ? sh : 0) - oy;
+    double px = dx + a.c * lx * kx - a.s * ly * ky;
+    double py = dy + a.s * lx * kx + a.c * ly * ky;
+    if (px < minx) minx = px;
+    if (px > maxx) maxx = px;
+    if (py < miny) miny = py;
+    if (py > maxy) maxy = py;
+  }
+  a.x0 = (minx < 0) ? 0 : floor(minx);
+  a.x1 = (maxx > bufw) ? bufw : ceil(maxx);
+  int y0 = (miny < 0) ? 0 : floor(miny);
+  int y1 = (maxy > bufh) ? bufh : ceil(maxy);
+  if (a.x0 >= a.x1 || y0 >= y1) return;
+
+  /* Source steps per destination pixel along a row */
+  a.dudx = a.c / kx * 65536.;
+  a.dvdx = -a.s / ky * 65536.;
+  a.uw = sw << 16;
+  a.vh = sh << 16;
+
+  #define AFFINE_LOOP(func, read)\
+    for (y = y0; y < y1; y++) {\
+      int u, v, first;\
+      int n = affineRow(&a, y, &u, &v, &first);\
+      if (n == 0) continue;\
+      pixel_t *d = buf + a.x0 + first + y * bufs;\
+      for (x = 0; x < n; x++) {\
+        int srci = (sy + (v >> 16)) * self->stride + sx + (u >> 16);\
+        func(*d, read(srci), self->mask[srci])\
+        d++;\
+        u += a.dudx;\
+        v += a.dvdx;\
+      }\
+    }
+
+  if (remap) {
+    BLIT(AFFINE_LOOP, READ_REMAP);
+  } else {
+    BLIT(AFFINE_LOOP, READ_DIRECT);
+  }
+}
+
+
+void image_blitPerspective(image_t *self, pixel_t *buf, int bufw, int bufh,
+                           int bufs, int dx, int dy, int dw, int dh,
+                           double camx, double camy, double angle,
+                           double height, double horizon, double focal,
+                           int wrap
+) {
+  /* Fills the destination rect with the image as a floor plane seen from a
+   * camera `height` units above `camx`, `camy` facing `angle`. Each row below
+   * the `horizon` row is a line of constant distance across the plane, so its
+   * source coordinates are stepped linearly in 16.16 fixed point */
+  int x, y, diff;
+  int sw = self->width, sh = self->height;
+  if (focal <= 0 || height == 0) return;
+  double center = dw / 2.;
+
+  /* Clip to destination buffer */
+  int left = 0;
+  if (dx < 0) { dw += dx; left = -dx; dx = 0; }
+  if (dy < 0) { dh += dy; horizon += dy; dy = 0; }
+  if ((diff = (dx + dw) - bufw) > 0) { dw -= diff; }
+  if ((diff = (dy + dh) - bufh) > 0) { dh -= diff; }
+  if (dw <= 0 || dh <= 0) return;
+
+  const pixel_t *remap = image_remap;
+  const pixel_t *table = NULL;
+  if (image_blendMode >= IMAGE_ALPHA) {
+    table = palette_getBlendTable(
+      PALETTE_BLEND_ALPHA + image_blendMode - IMAGE_ALPHA);
+  }
+
+  double fx = cos(angle), fy = sin(angle);
+  int uw = sw << 16, vh = sh << 16;
+  int y0 = (horizon > 0) ? ceil(horizon) : 0;
+  if (y0 >= dh) return;
+
+  #define PERSPECTIVE_LOOP(func, read)\
+    for (y = y0; y < dh; y++) {\
+      double dist = height * focal / (y - horizon + 0.5);\
+      double scale = dist / focal;\
+      double off = left - center + 0.5;\
+      double su = (camx + fx * dist - fy * off * scale) * 65536.;\
+      double sv = (camy + fy * dist + fx * off * scale) * 65536.;\
+      double sdu = -fy * scale * 65536.;\
+      double sdv = fx * scale * 65536.;\
+      pixel_t *d = buf + dx + (dy + y) * bufs;\
+      int n = dw, u, v, du, dv;\
+      if (wrap) {\
+        /* Keep coordinates and steps within a single repeat of the image */\
+        su = fmod(su, uw); if (su < 0) su += uw;\
+        sv = fmod(sv, vh); if (sv < 0) sv += vh;\
+        u = su; v = sv;\
+        du = fmod(sdu, uw);\
+        dv = fmod(sdv, vh);\
+        if (u >= uw) u -= uw;\
+        if (v >= vh) v -= vh;\
+      } else {\
+        long long lo = 0, hi = dw - 1;\
+        if (fabs(sdu) >= 0x7fffffff || fabs(sdv) >= 0x7fffffff ||\
+            fabs(su) >= 0x7fffffffffffLL || fabs(sv) >= 0x7fffffffffffLL) {\
+          continue;\
+        }\
+        du = sdu;\
+        dv = sdv;\
+        clampSpan(&lo, &hi, floor(su), du, uw);\
+        clampSpan(&lo, &hi, floor(sv), dv, vh);\
+        if (hi < lo) continue;\
+        u = (long long) floor(su) + lo * du;\
+        v = (long long) floor(sv) + lo * dv;\
+        d += lo;\
+        n = hi - lo + 1;\
+      }\
+      for (x = 0; x < n; x++) {\
+        int srci = (v >> 16) * self->stride + (u >> 16);\
+        func(*d, read(srci), self->mask[srci])\
+        d++;\
+        u += du;\
+        v += dv;\
+        if (wrap) {\
+          if (u >= uw) u -= uw; else if (u < 0) u += uw;\
+          if (v >= vh) v -= vh; else if (v < 0) v += vh;\
+        }\
+      }\
     }
+
+  if (remap) {
+    BLIT(PERSPECTIVE_LOOP, READ_REMAP);
   } else {
-    BLIT(BLIT_LOOP_FLIPPED);
+    BLIT(PERSPECTIVE_LOOP, READ_DIRECT);
   }
+}
+
+
+static int nineSliceMap(int u, int d, int a, int b, int s, int tile) {
+  /* Maps the offset `u` along a destination span `d` pixels long to an offset
+   * in the source span `s` pixels long, whose first `a` and last `b` pixels
+   * are drawn once at either end and whose middle is tiled or stretched to
+   * fill the rest. Returns -1 if the source has no middle */
+  if (u < a) return u;
+  if (u >= d - b) return s - (d - u);
+  int m = s - a - b;
+  if (m <= 0) return -1;
+  return tile ? a + (u - a) % m : a + (long long) (u - a) * m / (d - a - b);
+}
+
+
+#define NINE_SLICE_CACHE  16
+#define NINE_SLICE_COLS   512
+
+unsigned image_maskVersion;
+
+/* Which of the nine patches of recently drawn panels are fully opaque, so that
+ * a panel drawn every frame only has its mask scanned once */
+typedef struct {
+  image_t *image;
+  unsigned version;
+  int sx, sy, sw, sh;
+  int left, top, right, bottom;
+  char opaque[3][3];
+} nineslice_opacity_t;
 
+static nineslice_opacity_t nineSliceCache[NINE_SLICE_CACHE];
+static int nineSliceCacheNext;
+
+
+static nineslice_opacity_t *nineSliceOpacity(image_t *self,
+                                             int sx, int sy, int sw, int sh,
+                                             int left, int top,
+                                             int right, int bottom
+) {
+  /* Returns the opacity of each patch of the source rect split by the insets,
+   * from the cache if it holds it */
+  int i, j, x, y;
+  nineslice_opacity_t *e;
+  for (i = 0; i < NINE_SLICE_CACHE; i++) {
+    e = &nineSliceCache[i];
+    if (e->image == self && e->version == image_maskVersion &&
+        e->sx == sx && e->sy == sy && e->sw == sw && e->sh == sh &&
+        e->left == left && e->top == top &&
+        e->right == right && e->bottom == bottom) {
+      return e;
+    }
+  }
+  e = &nineSliceCache[nineSliceCacheNext];
+  nineSliceCacheNext = (nineSliceCacheNext + 1) % NINE_SLICE_CACHE;
+  e->image = self;
+  e->version = image_maskVersion;
+  e->sx = sx; e->sy = sy; e->sw = sw; e->sh = sh;
+  e->left = left; e->top = top; e->right = right; e->bottom = bottom;
+  int us[4] = { 0, left, sw - right, sw };
+  int vs[4] = { 0, top, sh - bottom, sh };
+  for (j = 0; j < 3; j++) {
+    for (i = 0; i < 3; i++) {
+      e->opaque[j][i] = 1;
+      for (y = vs[j]; y < vs[j + 1] && e->opaque[j][i]; y++) {
+        const pixel_t *m = self->mask + (sy + y) * self->stride + sx;
+        for (x = us[i]; x < us[i + 1]; x++) {
+          if (m[x]) { e->opaque[j][i] = 0; break; }
+        }
+      }
+    }
+  }
+  return e;
+}
+
+
+void image_blitNineSlice(image_t *self, pixel_t *buf, int bufw, int bufh,
+                         int bufs, int dx, int dy, int dw, int dh,
+                         int sx, int sy, int sw, int sh,
+                         int left, int top, int right, int bottom, int tile
+) {
+  /* Fills the destination rect with the source rect split into nine patches
+   * by the insets: the corners are drawn once, the edges and center are tiled
+   * or stretched between them. The source rect must lie inside the image.
+   * Clipping is done once for the whole rect and each row is drawn as three
+   * spans; spans which don't need blending are copied with memcpy */
+  static int cols[NINE_SLICE_COLS];
+  int x, y, i, j, xa, xb;
+  if (dw <= 0 || dh <= 0) return;
+
+  /* Shrink the insets if the rect is too small to fit both */
+  if (left + right > dw) {
+    left = left * dw / (left + right);
+    right = dw - left;
+  }
+  if (top + bottom > dh) {
+    top = top * dh / (top + bottom);
+    bottom = dh - top;
+  }
+
+  /* Clip to destination buffer */
+  int xmin = (dx < 0) ? 0 : dx;
+  int ya = (dy < 0) ? 0 : dy;
+  int xmax = (dx + dw > bufw) ? bufw : dx + dw;
+  int yb = (dy + dh > bufh) ? bufh : dy + dh;
+  if (xmin >= xmax || ya >= yb) return;
+
+  const pixel_t *remap = image_remap;
+  const pixel_t *table = NULL;
+  if (image_blendMode >= IMAGE_ALPHA) {
+    table = palette_getBlendTable(
+      PALETTE_BLEND_ALPHA + image_blendMode - IMAGE_ALPHA);
+  }
+
+  /* Find which of the nine patches can be copied rather than blended */
+  int copy[3][3];
+  nineslice_opacity_t *op = NULL;
+  if (!remap && image_blendMode == IMAGE_NORMAL) {
+    op = nineSliceOpacity(self, sx, sy, sw, sh, left, top, right, bottom);
+  }
+  for (j = 0; j < 3; j++) {
+    for (i = 0; i < 3; i++) {
+      copy[j][i] = !remap && (image_blendMode == IMAGE_FAST ||
+                              (op && op->opaque[j][i]));
+    }
+  }
+
+  /* The source columns at which each span ends */
+  int ends[3];
+  ends[0] = left;
+  ends[1] = sw - right;
+  ends[2] = sw;
+
+  #define NINE_SLICE_LOOP(func, read)\
+    for (x = x0; x < x1; x++) {\
+      int srci = row + cols[x - xa];\
+      func(d[x], read(srci), self->mask[srci])\
+    }
+
+  /* Columns are drawn in strips no wider than the column map */
+  for (xa = xmin; xa < xmax; xa = xb) {
+    xb = (xmax - xa > NINE_SLICE_COLS) ? xa + NINE_SLICE_COLS : xmax;
+
+    /* Get the destination columns at which each span starts and map each
+     * destination column to a source column */
+    int edges[4];
+    edges[0] = xa;
+    edges[1] = dx + left;
+    edges[2] = dx + dw - right;
+    edges[3] = xb;
+    for (i = 1; i < 3; i++) {
+      if (edges[i] < xa) edges[i] = xa;
+      if (edges[i] > xb) edges[i] = xb;
+    }
+    for (x = xa; x < xb; x++) {
+      cols[x - xa] = nineSliceMap(x - dx, dw, left, right, sw, tile);
+    }
+
+    for (y = ya; y < yb; y++) {
+      int v = nineSliceMap(y - dy, dh, top, bottom, sh, tile);
+      if (v < 0) continue;
+      int band = (v < top) ? 0 : (v < sh - bottom) ? 1 : 2;
+      int row = (sy + v) * self->stride + sx;
+      pixel_t *d = buf + y * bufs;
+      for (i = 0; i < 3; i++) {
+        int x0 = edges[i], x1 = edges[i + 1];
+        if (x0 >= x1 || (i == 1 && sw - left - right <= 0)) continue;
+        if (!copy[band][i]) {
+          if (remap) {
+            BLIT(NINE_SLICE_LOOP, READ_REMAP);
+          } else {
+            BLIT(NINE_SLICE_LOOP, READ_DIRECT);
+          }
+        } else if (i != 1 || tile) {
+          /* Source columns are contiguous up to the end of the patch */
+          for (x = x0; x < x1;) {
+            int c = cols[x - xa];
+            int n = ends[i] - c;
+            if (n > x1 - x) n = x1 - x;
+            memcpy(d + x, self->data + row + c, n);
+            x += n;
+          }
+        } else {
+          NINE_SLICE_LOOP(BLIT_FAST, READ_DIRECT);
+        }
+      }
+    }
+  }
+}
+
+
+static int clipRegion(image_region_t *r) {
+  /* Clips the region's source rect to its image, moving its position to
+   * match. Returns 0 if nothing is left */
+  int diff;
+  if (r->sx < 0) { r->sw += r->sx; if (!r->flip) r->x -= r->sx; r->sx = 0; }
+  if (r->sy < 0) { r->sh += r->sy; r->y -= r->sy; r->sy = 0; }
+  if ((diff = (r->sx + r->sw) - r->image->width) > 0) {
+    r->sw -= diff;
+    if (r->flip) r->x += diff;
+  }
+  if ((diff = (r->sy + r->sh) - r->image->height) > 0) { r->sh -= diff; }
+  return r->sw > 0 && r->sh > 0;
+}
+
+
+static const pixel_t *maskSpan(const image_region_t *r, int x, int y,
+                               int len, pixel_t *tmp
+) {
+  /* Returns the `len` mask bytes of the region covering the positions from
+   * `x`, `y` rightwards; if the region is flipped they are reversed into
+   * `tmp` */
+  const pixel_t *m = r->image->mask + (r->sy + y - r->y) * r->image->stride;
+  if (!r->flip) {
+    return m + r->sx + (x - r->x);
+  }
+  int i, c = r->sx + r->sw - 1 - (x - r->x);
+  for (i = 0; i < len; i++) {
+    tmp[i] = m[c - i];
+  }
+  return tmp;
+}
+
+
+int image_overlap(image_region_t a, image_region_t b, int *hitx, int *hity) {
+  /* Compares the masks of the two regions where their rects intersect. If
+   * `hitx` is not NULL the position of the first pixel (scanning rows top to
+   * bottom) which is opaque in both is stored and 1 is returned, or 0 if
+   * there is none; otherwise the number of such pixels is returned. As mask
+   * bytes are 0x00 where opaque, a word of both masks ORed together is all
+   * ones unless there is an overlap in it, so rows are compared a word at a
+   * time */
+  #define SPAN_MAX 256
+  pixel_t tmpa[SPAN_MAX], tmpb[SPAN_MAX];
+  int x, y, i, k, count = 0;
+
+  if (!clipRegion(&a) || !clipRegion(&b)) return 0;
+  int x0 = (a.x > b.x) ? a.x : b.x;
+  int y0 = (a.y > b.y) ? a.y : b.y;
+  int x1 = (a.x + a.sw < b.x + b.sw) ? a.x + a.sw : b.x + b.sw;
+  int y1 = (a.y + a.sh < b.y + b.sh) ? a.y + a.sh : b.y + b.sh;
+
+  for (y = y0; y < y1; y++) {
+    /* Rows are compared in spans so flipped rows fit the temp buffers */
+    for (x = x0; x < x1; x += SPAN_MAX) {
+      int len = (x1 - x < SPAN_MAX) ? x1 - x : SPAN_MAX;
+      const pixel_t *ma = maskSpan(&a, x, y, len, tmpa);
+      const pixel_t *mb = maskSpan(&b, x, y, len, tmpb);
+      for (i = 0; i + 4 <= len; i += 4) {
+        unsigned v = ~(*(unsigned*) &ma[i] | *(unsigned*) &mb[i]);
+        if (!v) continue;
+        if (!hitx) {
+          count += __builtin_popcount(v) >> 3;
+          continue;
+        }
+        for (k = 0; ma[i + k] | mb[i + k]; k++);
+        *hitx = x + i + k;
+        *hity = y;
+        return 1;
+      }
+      for (; i < len; i++) {
+        if (ma[i] | mb[i]) continue;
+        if (!hitx) {
+          count++;
+          continue;
+        }
+        *hitx = x + i;
+        *hity = y;
+        return 1;
+      }
+    }
+  }
+  #undef SPAN_MAX
+  return count;
+}
+
+
+void image_copy(image_t *self, image_t *src,
+                int sx, int sy, int w, int h, int dx, int dy
+) {
+  /* Copies the source rect of `src` to the `dx`, `dy` position of the image,
+   * pixels and mask, clipped to both images. The two may share pixels, as
+   * when scrolling an image or copying between views of one canvas, so rows
+   * are copied with memmove and bottom-up when the destination comes after
+   * the source */
+  if (sx < 0) { w += sx; dx -= sx; sx = 0; }
+  if (sy < 0) { h += sy; dy -= sy; sy = 0; }
+  if (dx < 0) { w += dx; sx -= dx; dx = 0; }
+  if (dy < 0) { h += dy; sy -= dy; dy = 0; }
+  if (sx + w > src->width)   { w = src->width - sx; }
+  if (sy + h > src->height)  { h = src->height - sy; }
+  if (dx + w > self->width)  { w = self->width - dx; }
+  if (dy + h > self->height) { h = self->height - dy; }
+  if (w <= 0 || h <= 0) return;
+  image_maskVersion++;
+
+  pixel_t *sd = src->data + sx + sy * src->stride;
+  pixel_t *sm = src->mask + sx + sy * src->stride;
+  pixel_t *dd = self->data + dx + dy * self->stride;
+  pixel_t *dm = self->mask + dx + dy * self->stride;
+  int ss = src->stride, ds = self->stride;
+  if (dd > sd) {
+    sd += (h - 1) * ss; sm += (h - 1) * ss; ss = -ss;
+    dd += (h - 1) * ds; dm += (h - 1) * ds; ds = -ds;
+  }
+  while (h--) {
+    memmove(dd, sd, w);
+    memmove(dm, sm, w);
+    sd += ss; sm += ss;
+    dd += ds; dm += ds;
+  }
 }
 
 
 void image_deinit(image_t *self) {
+  image_maskVersion++;
+  if (self->parent) return;
+  unlinkImage(self);
   dmt_free(self->data);
   dmt_free(self->mask);
 }
+
+
+void image_markPalette(char *used) {
+  /* Sets the `used` flag of every palette idx which appears in a live image.
+   * Views are not in the list as their pixels belong to their parent */
+  image_t *img;
+  for (img = image_list; img; img = img->next) {
+    int i, sz = img->width * img->height;
+    for (i = 0; i < sz; i++) {
+      used[img->data[i]] = 1;
+    }
+  }
+}
+
+
+void image_remapPalette(const pixel_t *remap) {
+  /* Replaces every pixel of every live image through the `remap` table */
+  image_t *img;
+  for (img = image_list; img; img = img->next) {
+    int i, sz = img->width * img->height;
+    for (i = 0; i < sz; i++) {
+      img->data[i] = remap[img->data[i]];
+    }
+  }
+}
@@ -18,38 +18,78 @@ enum {
   IMAGE_AND,
   IMAGE_OR,
   IMAGE_COLOR,
-} IMAGE_BLEND_MODE;
+  IMAGE_ALPHA,
+  IMAGE_ADD,
+  IMAGE_MULTIPLY,
+};
 
 
-typedef struct {
+typedef struct image_t {
   pixel_t *data;
   pixel_t *mask;
-  int width, height;
+  int width, height, stride;
+  struct image_t *parent;
+  struct image_t *prev, *next;
 } image_t;
 
+typedef struct {
+  image_t *image;
+  int x, y;
+  int sx, sy, sw, sh;
+  int flip;
+} image_region_t;
+
 
 static inline
 void image_setPixel(image_t* self, int x, int y, pixel_t val) {
   if (x >= 0 && x < self->width && y >= 0 && y < self->height) {
-    self->data[x + y * self->width] = val;
+    self->data[x + y * self->stride] = val;
   }
 }
 
+/* Incremented whenever an image's mask is changed or an image is freed, so
+ * that information derived from masks can be cached */
+extern unsigned image_maskVersion;
+
 static inline
 void image_setMaskPixel(image_t* self, int x, int y, pixel_t val) {
   if (x >= 0 && x < self->width && y >= 0 && y < self->height) {
-    self->mask[x + y * self->width] = val;
+    self->mask[x + y * self->stride] = val;
+    image_maskVersion++;
   }
 }
 
 void image_setColor(pixel_t color);
 void image_setBlendMode(int mode);
 void image_setFlip(int mode);
+void image_setRemap(const pixel_t *remap);
 
 const char *image_init(image_t *self, const char *filename);
+const char *image_initQuantized(image_t *self, const char *filename,
+                                int colors, int dither);
 void image_initBlank(image_t*, int, int);
-void image_blit(image_t *self, pixel_t *buf, int bufw, int bufh,
+void image_initView(image_t *self, image_t *parent,
+                    int x, int y, int width, int height);
+void image_blit(image_t *self, pixel_t *buf, int bufw, int bufh, int bufs,
                 int dx, int dy, int sx, int sy, int sw, int sh);
+void image_blitTransform(image_t *self, pixel_t *buf, int bufw, int bufh,
+                         int bufs, double dx, double dy,
+                         int sx, int sy, int sw, int sh,
+                         double r, double kx, double ky, double ox, double oy);
+void image_blitPerspective(image_t *self, pixel_t *buf, int bufw, int bufh,
+                           int bufs, int dx, int dy, int dw, int dh,
+                           double camx, double camy, double angle,
+                           double height, double horizon, double focal,
+                           int wrap);
+void image_blitNineSlice(image_t *self, pixel_t *buf, int bufw, int bufh,
+                         int bufs, int dx, int dy, int dw, int dh,
+                         int sx, int sy, int sw, int sh,
+                         int left, int top, int right, int bottom, int tile);
+int image_overlap(image_region_t a, image_region_t b, int *hitx, int *hity);
+void image_copy(image_t *self, image_t *src,
+                int sx, int sy, int w, int h, int dx, int dy);
 void image_deinit(image_t*);
+void image_markPalette(char *used);
+void image_remapPalette(const pixel_t *remap);
 
 #endif
@@ -5,6 +5,8 @@
  * under the terms of the MIT license. See LICENSE for details.
  */
 
+#ifdef __DJGPP__
+
 #include <stdlib.h>
 #include <string.h>
 #include <pc.h>
@@ -270,3 +272,5 @@ void keyboard_update(void) {
     event_push(&e);
   }
 }
+
+#endif
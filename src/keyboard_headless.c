@@ -0,0 +1,37 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef __DJGPP__
+
+#include "keyboard.h"
+
+/* Headless keyboard backend for host builds: there is no keyboard, so no key
+ * is ever down and no events are pushed */
+
+
+int keyboard_init(void) {
+  return 0;
+}
+
+
+void keyboard_deinit(void) {
+}
+
+
+void keyboard_setKeyRepeat(int allow) {
+}
+
+
+int keyboard_isDown(const char *key) {
+  return 0;
+}
+
+
+void keyboard_update(void) {
+}
+
+#endif
@@ -90,3 +90,13 @@ void *luaobj_checkudata(lua_State *L, int index, uint32_t type) {
   return udata + 1;
 }
 
+
+void *luaobj_toudata(lua_State *L, int index, uint32_t type) {
+  /* Returns the udata's body if the value at the given index is a luaobj
+   * udata of the correct class, else returns NULL */
+  luaobj_head_t *udata = lua_touserdata(L, index);
+  if (!udata || !(udata->type & type)) {
+    return NULL;
+  }
+  return udata + 1;
+}
@@ -22,10 +22,14 @@ typedef struct {
 
 /* Each mask should consist of its unique bit and the unique bit of all its
  * super classes */
-#define LUAOBJ_TYPE_IMAGE  (1 << 0)
-#define LUAOBJ_TYPE_QUAD   (1 << 1)
-#define LUAOBJ_TYPE_FONT   (1 << 2)
-#define LUAOBJ_TYPE_SOURCE (1 << 3)
+#define LUAOBJ_TYPE_IMAGE          (1 << 0)
+#define LUAOBJ_TYPE_QUAD           (1 << 1)
+#define LUAOBJ_TYPE_FONT           (1 << 2)
+#define LUAOBJ_TYPE_SOURCE         (1 << 3)
+#define LUAOBJ_TYPE_DRAWLIST       (1 << 4)
+#define LUAOBJ_TYPE_DRAWQUEUE      (1 << 5)
+#define LUAOBJ_TYPE_SPATIALHASH    (1 << 6)
+#define LUAOBJ_TYPE_PARTICLESYSTEM (1 << 7)
 
 
 int luaobj_newclass(lua_State *L, const char *name, const char *extends,
@@ -33,6 +37,7 @@ int luaobj_newclass(lua_State *L, const char *name, const char *extends,
 void luaobj_setclass(lua_State *L, uint32_t type, char *name);
 void *luaobj_newudata(lua_State *L, int size);
 void *luaobj_checkudata(lua_State *L, int index, uint32_t type);
+void *luaobj_toudata(lua_State *L, int index, uint32_t type);
 
 
 #endif
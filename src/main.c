@@ -8,8 +8,6 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <time.h>
-#include <dos.h>
 
 #include "lib/dmt/dmt.h"
 
@@ -22,6 +20,7 @@
 #include "image.h"
 #include "palette.h"
 #include "package.h"
+#include "event.h"
 
 
 static lua_State *L;
@@ -32,7 +31,9 @@ static void deinit(void) {
   vga_deinit();
   keyboard_deinit();
   lua_close(L);
+  palette_deinit();
   filesystem_deinit();
+  event_deinit();
   if ( dmt_usage() > 0 ) {
     dmt_dump(stdout);
   }
@@ -47,6 +48,24 @@ static int onLuaPanic(lua_State *L) {
 }
 
 
+static const char *getOption(int *argc, char **argv, const char *name) {
+  /* Returns the value of the `name VALUE` option and removes the option from
+   * the arguments so the game doesn't see it, returns NULL if it is not set */
+  int i;
+  for (i = 1; i + 1 < *argc; i++) {
+    if (!strcmp(argv[i], name)) {
+      const char *value = argv[i + 1];
+      memmove(argv + i, argv + i + 2, (*argc - i - 1) * sizeof(*argv));
+      *argc -= 2;
+      return value;
+    }
+  }
+  return NULL;
+}
+
+
+extern double timer_fixedDt;
+
 int luaopen_love(lua_State *L);
 
 int main(int argc, char **argv) {
@@ -56,6 +75,30 @@ int main(int argc, char **argv) {
     exit(EXIT_SUCCESS);
   }
 
+  /* Benchmarks step every frame by a fixed delta and ignore device input so
+   * that runs are repeatable, unless they replay a recorded session */
+  const char *opt = getOption(&argc, argv, "--bench");
+  int benchFrames = opt ? atoi(opt) : 0;
+  if (benchFrames > 0) {
+    timer_fixedDt = 1. / 60;
+    event_replay(NULL);
+  }
+  if ( (opt = getOption(&argc, argv, "--record")) ) {
+    /* Benchmarks ignore device input, so there would be nothing to record */
+    if (benchFrames > 0) {
+      fprintf(stderr, "Error: --record can't be used with --bench\n");
+      exit(EXIT_FAILURE);
+    }
+    if (event_record(opt)) {
+      fprintf(stderr, "Error: could not open '%s' for recording\n", opt);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if ( (opt = getOption(&argc, argv, "--replay")) && event_replay(opt) ) {
+    fprintf(stderr, "Error: could not replay '%s'\n", opt);
+    exit(EXIT_FAILURE);
+  }
+
   /* Init everything */
   atexit(deinit);
   audio_init();
@@ -80,6 +123,10 @@ int main(int argc, char **argv) {
       lua_rawseti(L, -2, i + 1);
     }
     lua_setfield(L, -2, "argv");
+    if (benchFrames > 0) {
+      lua_pushinteger(L, benchFrames);
+      lua_setfield(L, -2, "benchFrames");
+    }
   }
   lua_pop(L, 1);
 
@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "drawlist.h"
+#include "luaobj.h"
+
+
+#define CLASS_TYPE  LUAOBJ_TYPE_DRAWLIST
+#define CLASS_NAME  "DrawList"
+
+
+int l_drawlist_new(lua_State *L) {
+  drawlist_t *self = luaobj_newudata(L, sizeof(*self));
+  luaobj_setclass(L, CLASS_TYPE, CLASS_NAME);
+  drawlist_init(self);
+  /* The images and fonts used by the list's commands are kept alive as keys
+   * of its uservalue table */
+  lua_newtable(L);
+  lua_setuservalue(L, -2);
+  return 1;
+}
+
+
+int l_drawlist_gc(lua_State *L) {
+  drawlist_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  drawlist_deinit(self);
+  return 0;
+}
+
+
+int l_drawlist_clear(lua_State *L) {
+  drawlist_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  drawlist_clear(self);
+  lua_newtable(L);
+  lua_setuservalue(L, 1);
+  return 0;
+}
+
+
+int l_drawlist_getCount(lua_State *L) {
+  drawlist_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  lua_pushinteger(L, self->count);
+  return 1;
+}
+
+
+int luaopen_drawlist(lua_State *L) {
+  luaL_Reg reg[] = {
+    { "new",          l_drawlist_new      },
+    { "__gc",         l_drawlist_gc       },
+    { "clear",        l_drawlist_clear    },
+    { "getCount",     l_drawlist_getCount },
+    { 0, 0 },
+  };
+  luaobj_newclass(L, CLASS_NAME, NULL, l_drawlist_new, reg);
+  return 1;
+}
@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "drawqueue.h"
+#include "quad.h"
+#include "luaobj.h"
+
+
+#define CLASS_TYPE  LUAOBJ_TYPE_DRAWQUEUE
+#define CLASS_NAME  "DrawQueue"
+
+extern image_t *graphics_canvas;
+extern int graphics_translate[2];
+
+
+int l_drawqueue_new(lua_State *L) {
+  drawqueue_t *self = luaobj_newudata(L, sizeof(*self));
+  luaobj_setclass(L, CLASS_TYPE, CLASS_NAME);
+  drawqueue_init(self);
+  /* Each entry's image is kept alive at the entry's index in the uservalue
+   * table. Slots are overwritten rather than cleared when the queue is
+   * refilled so that a queue used each frame creates no garbage */
+  lua_newtable(L);
+  lua_setuservalue(L, -2);
+  return 1;
+}
+
+
+int l_drawqueue_gc(lua_State *L) {
+  drawqueue_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  drawqueue_deinit(self);
+  return 0;
+}
+
+
+int l_drawqueue_add(lua_State *L) {
+  drawqueue_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  float depth = luaL_checknumber(L, 2);
+  image_t *img = luaobj_checkudata(L, 3, LUAOBJ_TYPE_IMAGE);
+  int n = 4;
+  int sx = 0, sy = 0, sw = img->width, sh = img->height;
+  if (!lua_isnone(L, 4) && lua_type(L, 4) != LUA_TNUMBER) {
+    quadrect_t *quad = luaobj_checkudata(L, 4, LUAOBJ_TYPE_QUAD);
+    sx = quad->x;
+    sy = quad->y;
+    sw = quad->width;
+    sh = quad->height;
+    n = 5;
+  }
+  int x = luaL_optnumber(L, n, 0);
+  int y = luaL_optnumber(L, n + 1, 0);
+  int flip = lua_toboolean(L, n + 2);
+  drawqueue_entry_t *e = drawqueue_push(self, depth);
+  e->image = img;
+  e->sx = sx;
+  e->sy = sy;
+  e->sw = sw;
+  e->sh = sh;
+  e->x = x;
+  e->y = y;
+  e->flip = flip;
+  /* Keep image alive */
+  lua_getuservalue(L, 1);
+  lua_pushvalue(L, 3);
+  lua_rawseti(L, -2, self->count);
+  return 0;
+}
+
+
+int l_drawqueue_flush(lua_State *L) {
+  drawqueue_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  const drawqueue_key_t *keys = drawqueue_sort(self);
+  pixel_t *buf = graphics_canvas->data;
+  int bufw = graphics_canvas->width;
+  int bufh = graphics_canvas->height;
+  int bufs = graphics_canvas->stride;
+  int i;
+  for (i = 0; i < self->count; i++) {
+    drawqueue_entry_t *e = &self->entries[keys[i].idx];
+    image_setFlip(e->flip);
+    image_blit(e->image, buf, bufw, bufh, bufs,
+               e->x + graphics_translate[0], e->y + graphics_translate[1],
+               e->sx, e->sy, e->sw, e->sh);
+  }
+  image_setFlip(0);
+  self->count = 0;
+  return 0;
+}
+
+
+int l_drawqueue_clear(lua_State *L) {
+  drawqueue_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  self->count = 0;
+  lua_newtable(L);
+  lua_setuservalue(L, 1);
+  return 0;
+}
+
+
+int l_drawqueue_getCount(lua_State *L) {
+  drawqueue_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  lua_pushinteger(L, self->count);
+  return 1;
+}
+
+
+int luaopen_drawqueue(lua_State *L) {
+  luaL_Reg reg[] = {
+    { "new",          l_drawqueue_new       },
+    { "__gc",         l_drawqueue_gc        },
+    { "add",          l_drawqueue_add       },
+    { "flush",        l_drawqueue_flush     },
+    { "clear",        l_drawqueue_clear     },
+    { "getCount",     l_drawqueue_getCount  },
+    { 0, 0 },
+  };
+  luaobj_newclass(L, CLASS_NAME, NULL, l_drawqueue_new, reg);
+  return 1;
+}
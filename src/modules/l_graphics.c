@@ -7,14 +7,17 @@
 
 #include <string.h>
 #include <stdlib.h>
-#include <pc.h>
 #include "palette.h"
 #include "image.h"
 #include "font.h"
 #include "quad.h"
+#include "drawlist.h"
+#include "particlesystem.h"
 #include "vga.h"
 #include "luaobj.h"
 
+#define GRAPHICS_MAX_TRANSFORMS 64
+
 image_t  *graphics_screen;
 font_t   *graphics_defaultFont;
 
@@ -25,6 +28,12 @@ int       graphics_backgroundColor_rgb[3];
 pixel_t   graphics_color;
 int       graphics_color_rgb[3];
 int       graphics_blendMode;
+pixel_t   graphics_remap[256];
+int       graphics_remapActive;
+drawlist_t *graphics_drawList;
+int       graphics_translate[2];
+int       graphics_transformStack[GRAPHICS_MAX_TRANSFORMS][2];
+int       graphics_transformDepth;
 
 
 static int getColorFromArgs(lua_State *L, int *rgb, const int *def) {
@@ -107,11 +116,14 @@ int l_graphics_setColor(lua_State *L) {
 int l_graphics_getBlendMode(lua_State *L) {
   switch (graphics_blendMode) {
     default:
-    case IMAGE_NORMAL : lua_pushstring(L, "normal");  break;
-    case IMAGE_FAST   : lua_pushstring(L, "fast");    break;
-    case IMAGE_AND    : lua_pushstring(L, "and");     break;
-    case IMAGE_OR     : lua_pushstring(L, "or");      break;
-    case IMAGE_COLOR  : lua_pushstring(L, "color");   break;
+    case IMAGE_NORMAL   : lua_pushstring(L, "normal");    break;
+    case IMAGE_FAST     : lua_pushstring(L, "fast");      break;
+    case IMAGE_AND      : lua_pushstring(L, "and");       break;
+    case IMAGE_OR       : lua_pushstring(L, "or");        break;
+    case IMAGE_COLOR    : lua_pushstring(L, "color");     break;
+    case IMAGE_ALPHA    : lua_pushstring(L, "alpha");     break;
+    case IMAGE_ADD      : lua_pushstring(L, "add");       break;
+    case IMAGE_MULTIPLY : lua_pushstring(L, "multiply");  break;
   }
   return 1;
 }
@@ -119,9 +131,9 @@ int l_graphics_getBlendMode(lua_State *L) {
 
 int l_graphics_setBlendMode(lua_State *L) {
   const char *str = lua_isnoneornil(L, 1) ? "normal" : luaL_checkstring(L, 1);
-  #define SET_BLEND_MODE(str, e)\
+  #define SET_BLEND_MODE(name, e)\
     do {\
-      if (!strcmp(str, str)) {\
+      if (!strcmp(str, name)) {\
         graphics_blendMode = e;\
         image_setBlendMode(graphics_blendMode);\
         return 0;\
@@ -129,11 +141,14 @@ int l_graphics_setBlendMode(lua_State *L) {
     } while (0)
 
   switch (*str) {
-    case 'n'  : SET_BLEND_MODE("normal",  IMAGE_NORMAL);  break;
-    case 'f'  : SET_BLEND_MODE("fast",    IMAGE_FAST);    break;
-    case 'a'  : SET_BLEND_MODE("and",     IMAGE_AND);     break;
-    case 'o'  : SET_BLEND_MODE("or",      IMAGE_OR);      break;
-    case 'c'  : SET_BLEND_MODE("color",   IMAGE_COLOR);   break;
+    case 'n'  : SET_BLEND_MODE("normal",    IMAGE_NORMAL);    break;
+    case 'f'  : SET_BLEND_MODE("fast",      IMAGE_FAST);      break;
+    case 'a'  : SET_BLEND_MODE("and",       IMAGE_AND);
+                SET_BLEND_MODE("alpha",     IMAGE_ALPHA);
+                SET_BLEND_MODE("add",       IMAGE_ADD);       break;
+    case 'o'  : SET_BLEND_MODE("or",        IMAGE_OR);        break;
+    case 'c'  : SET_BLEND_MODE("color",     IMAGE_COLOR);     break;
+    case 'm'  : SET_BLEND_MODE("multiply",  IMAGE_MULTIPLY);  break;
   }
   #undef SET_BLEND_MODE
   luaL_argerror(L, 1, "bad blend mode");
@@ -141,6 +156,180 @@ int l_graphics_setBlendMode(lua_State *L) {
 }
 
 
+int l_graphics_getPaletteMode(lua_State *L) {
+  switch (palette_getMode()) {
+    default:
+    case PALETTE_EXACT    : lua_pushstring(L, "exact");   break;
+    case PALETTE_NEAREST  : lua_pushstring(L, "nearest"); break;
+  }
+  return 1;
+}
+
+
+int l_graphics_setPaletteMode(lua_State *L) {
+  const char *str = lua_isnoneornil(L, 1) ? "exact" : luaL_checkstring(L, 1);
+  if (!strcmp(str, "exact")) {
+    palette_setMode(PALETTE_EXACT);
+  } else if (!strcmp(str, "nearest")) {
+    palette_setMode(PALETTE_NEAREST);
+  } else {
+    luaL_argerror(L, 1, "bad palette mode");
+  }
+  return 0;
+}
+
+
+int l_graphics_compactPalette(lua_State *L) {
+  /* Mark the colors still referenced by live images and the graphics state */
+  char used[256];
+  memset(used, 0, sizeof(used));
+  used[graphics_color] = 1;
+  used[graphics_backgroundColor] = 1;
+  image_markPalette(used);
+  int i;
+  if (graphics_remapActive) {
+    for (i = 0; i < 256; i++) {
+      if (used[i]) used[graphics_remap[i]] = 1;
+    }
+  }
+  /* Compact palette and remap everything which refers to it */
+  pixel_t remap[256];
+  int freed = palette_compact(used, remap);
+  image_remapPalette(remap);
+  graphics_color = remap[graphics_color];
+  graphics_backgroundColor = remap[graphics_backgroundColor];
+  image_setColor(graphics_color);
+  if (graphics_remapActive) {
+    pixel_t old[256];
+    memcpy(old, graphics_remap, sizeof(old));
+    for (i = 0; i < 256; i++) {
+      graphics_remap[i] = i;
+    }
+    for (i = 0; i < 256; i++) {
+      if (remap[i]) graphics_remap[remap[i]] = remap[old[i]];
+    }
+  }
+  lua_pushinteger(L, freed);
+  return 1;
+}
+
+
+int l_graphics_getPaletteIndex(lua_State *L) {
+  static const int def[] = { 0xff, 0xff, 0xff };
+  lua_pushinteger(L, getColorFromArgs(L, NULL, def));
+  return 1;
+}
+
+
+int l_graphics_getPaletteEntry(lua_State *L) {
+  int idx = luaL_checknumber(L, 1);
+  int rgb[3];
+  if (palette_idxToColor(idx, rgb) < 0) {
+    luaL_argerror(L, 1, "bad palette index");
+  }
+  return pushColor(L, rgb);
+}
+
+
+int l_graphics_setPaletteEntry(lua_State *L) {
+  int idx = luaL_checknumber(L, 1);
+  int r = luaL_checknumber(L, 2);
+  int g = luaL_checknumber(L, 3);
+  int b = luaL_checknumber(L, 4);
+  if (palette_setColor(idx, r, g, b) < 0) {
+    luaL_argerror(L, 1, "bad palette index");
+  }
+  return 0;
+}
+
+
+int l_graphics_cyclePalette(lua_State *L) {
+  int first = luaL_checknumber(L, 1);
+  int last = luaL_checknumber(L, 2);
+  double speed = luaL_optnumber(L, 3, 0);
+  if (first < 1 || first > 255) luaL_argerror(L, 1, "bad palette index");
+  if (last < first || last > 255) luaL_argerror(L, 2, "bad palette index");
+  if (palette_cycle(first, last, speed) < 0) {
+    luaL_error(L, "too many palette cycles");
+  }
+  return 0;
+}
+
+
+int l_graphics_fadePalette(lua_State *L) {
+  double duration = luaL_checknumber(L, 1);
+  unsigned target[256];
+  char has[256];
+  int i;
+  if (lua_isnoneornil(L, 2)) {
+    /* Fade back to the normal palette */
+    palette_fade(duration, NULL, NULL);
+    return 0;
+  }
+  if (lua_istable(L, 2)) {
+    /* Fade to palette: table of palette index => { r, g, b } */
+    memset(has, 0, sizeof(has));
+    for (i = 0; i < 256; i++) {
+      lua_rawgeti(L, 2, i);
+      if (lua_istable(L, -1)) {
+        int c[3], j;
+        for (j = 0; j < 3; j++) {
+          lua_rawgeti(L, -1, j + 1);
+          c[j] = lua_tonumber(L, -1);
+          lua_pop(L, 1);
+        }
+        target[i] = ((c[2] & 0xff) << 16) | ((c[1] & 0xff) << 8) |
+                    (c[0] & 0xff);
+        has[i] = 1;
+      }
+      lua_pop(L, 1);
+    }
+  } else {
+    /* Fade to color */
+    int r = luaL_checknumber(L, 2);
+    int g = luaL_checknumber(L, 3);
+    int b = luaL_checknumber(L, 4);
+    unsigned color = ((b & 0xff) << 16) | ((g & 0xff) << 8) | (r & 0xff);
+    for (i = 0; i < 256; i++) {
+      target[i] = color;
+    }
+    memset(has, 1, sizeof(has));
+  }
+  palette_fade(duration, target, has);
+  return 0;
+}
+
+
+int l_graphics_setRemap(lua_State *L) {
+  int i;
+  if (lua_isnoneornil(L, 1)) {
+    graphics_remapActive = 0;
+    image_setRemap(NULL);
+    return 0;
+  }
+  luaL_checktype(L, 1, LUA_TTABLE);
+  pixel_t remap[256];
+  for (i = 0; i < 256; i++) {
+    remap[i] = i;
+  }
+  /* Fill table from the palette index => palette index pairs */
+  lua_pushnil(L);
+  while (lua_next(L, 1)) {
+    int from = luaL_checknumber(L, -2);
+    int to = luaL_checknumber(L, -1);
+    if (from < 1 || from > 255 || to < 1 || to > 255) {
+      luaL_error(L, "bad palette index in remap table");
+    }
+    remap[from] = to;
+    lua_pop(L, 1);
+  }
+  memcpy(graphics_remap, remap, sizeof(remap));
+  graphics_remapActive = 1;
+  image_setRemap(graphics_remap);
+  return 0;
+}
+
+
 int l_graphics_getFont(lua_State *L) {
   lua_pushlightuserdata(L, graphics_font);
   lua_gettable(L, LUA_REGISTRYINDEX);
@@ -205,13 +394,77 @@ int l_graphics_setCanvas(lua_State *L) {
 }
 
 
+int l_graphics_getDrawList(lua_State *L) {
+  lua_pushlightuserdata(L, &graphics_drawList);
+  lua_gettable(L, LUA_REGISTRYINDEX);
+  return 1;
+}
+
+
+int l_graphics_setDrawList(lua_State *L) {
+  drawlist_t *list = NULL;
+  if (!lua_isnoneornil(L, 1)) {
+    list = luaobj_checkudata(L, 1, LUAOBJ_TYPE_DRAWLIST);
+  }
+  /* Keep the list being recorded in the registry */
+  lua_pushlightuserdata(L, &graphics_drawList);
+  if (list) {
+    lua_pushvalue(L, 1);
+  } else {
+    lua_pushnil(L);
+  }
+  lua_settable(L, LUA_REGISTRYINDEX);
+  graphics_drawList = list;
+  return 0;
+}
+
+
+int l_graphics_push(lua_State *L) {
+  if (graphics_transformDepth == GRAPHICS_MAX_TRANSFORMS) {
+    luaL_error(L, "transform stack overflow: too many pushes without a pop");
+  }
+  graphics_transformStack[graphics_transformDepth][0] = graphics_translate[0];
+  graphics_transformStack[graphics_transformDepth][1] = graphics_translate[1];
+  graphics_transformDepth++;
+  return 0;
+}
+
+
+int l_graphics_pop(lua_State *L) {
+  if (graphics_transformDepth == 0) {
+    luaL_error(L, "transform stack underflow: pop called without a push");
+  }
+  graphics_transformDepth--;
+  graphics_translate[0] = graphics_transformStack[graphics_transformDepth][0];
+  graphics_translate[1] = graphics_transformStack[graphics_transformDepth][1];
+  return 0;
+}
+
+
+int l_graphics_translate(lua_State *L) {
+  graphics_translate[0] += (int) luaL_checknumber(L, 1);
+  graphics_translate[1] += (int) luaL_checknumber(L, 2);
+  return 0;
+}
+
+
+int l_graphics_origin(lua_State *L) {
+  graphics_translate[0] = 0;
+  graphics_translate[1] = 0;
+  return 0;
+}
+
+
 int l_graphics_reset(lua_State *L) {
   int (*funcs[])(lua_State*) = {
     l_graphics_setBackgroundColor,
     l_graphics_setColor,
     l_graphics_setBlendMode,
+    l_graphics_setRemap,
     l_graphics_setFont,
     l_graphics_setCanvas,
+    l_graphics_setDrawList,
+    l_graphics_origin,
     NULL,
   };
   int i;
@@ -219,168 +472,133 @@ int l_graphics_reset(lua_State *L) {
     lua_pushcfunction(L, funcs[i]);
     lua_call(L, 0, 0);
   }
+  graphics_transformDepth = 0;
   return 0;
 }
 
 
 int l_graphics_clear(lua_State *L) {
   int idx = getColorFromArgs(L, NULL, graphics_backgroundColor_rgb);
-  int sz = graphics_canvas->width * graphics_canvas->height;
-  memset(graphics_canvas->data, idx, sz);
+  if (graphics_canvas->stride == graphics_canvas->width) {
+    int sz = graphics_canvas->width * graphics_canvas->height;
+    memset(graphics_canvas->data, idx, sz);
+  } else {
+    /* Canvas is a view: clear each of its rows */
+    int i;
+    for (i = 0; i < graphics_canvas->height; i++) {
+      memset(graphics_canvas->data + i * graphics_canvas->stride, idx,
+             graphics_canvas->width);
+    }
+  }
   return 0;
 }
 
 
 int l_graphics_present(lua_State *L) {
+  palette_flush();
   vga_update(graphics_screen->data);
   return 0;
 }
 
 
-int l_graphics_draw(lua_State *L) {
-  image_t *img = luaobj_checkudata(L, 1, LUAOBJ_TYPE_IMAGE);
-  quad_t *quad = NULL;
-  int x, y, flip;
-  if (!lua_isnone(L, 2) && lua_type(L, 2) != LUA_TNUMBER) {
-    quad = luaobj_checkudata(L, 2, LUAOBJ_TYPE_QUAD);
-    x = luaL_optnumber(L, 3, 0);
-    y = luaL_optnumber(L, 4, 0);
-    flip = !lua_isnone(L, 5) && lua_toboolean(L, 5);
-  } else {
-    x = luaL_optnumber(L, 2, 0);
-    y = luaL_optnumber(L, 3, 0);
-    flip = !lua_isnone(L, 4) && lua_toboolean(L, 4);
-  }
+static void drawImage(image_t *img, int sx, int sy, int sw, int sh,
+                      double x, double y, int flip, double r, double kx,
+                      double ky, double ox, double oy
+) {
   pixel_t *buf = graphics_canvas->data;
   int bufw = graphics_canvas->width;
   int bufh = graphics_canvas->height;
+  int bufs = graphics_canvas->stride;
   image_setFlip(flip);
-  if (quad) {
-    image_blit(img, buf, bufw, bufh, x, y,
-               quad->x, quad->y, quad->width, quad->height);
+  if (flip || (r == 0 && kx == 1 && ky == 1)) {
+    image_blit(img, buf, bufw, bufh, bufs, x - ox, y - oy, sx, sy, sw, sh);
   } else {
-    image_blit(img, buf, bufw, bufh, x, y,
-               0, 0, img->width, img->height);
+    image_blitTransform(img, buf, bufw, bufh, bufs, x, y, sx, sy, sw, sh,
+                        r, kx, ky, ox, oy);
   }
-  return 0;
-}
-
-
-int l_graphics_point(lua_State *L) {
-  int x = luaL_checknumber(L, 1);
-  int y = luaL_checknumber(L, 2);
-  image_setPixel(graphics_canvas, x, y, graphics_color);
-  return 0;
 }
 
 
-int l_graphics_line(lua_State *L) {
-  int argc = lua_gettop(L);
-  int lastx = luaL_checknumber(L, 1);
-  int lasty = luaL_checknumber(L, 2);
-  int idx = 3;
-  while (idx < argc) {
-    int x0 = lastx;
-    int y0 = lasty;
-    int x1 = luaL_checknumber(L, idx);
-    int y1 = luaL_checknumber(L, idx + 1);
-    lastx = x1;
-    lasty = y1;
-    /* Draw line */
-    #define SWAP_INT(a, b) (((a) ^= (b)), ((b) ^= (a)), ((a) ^= (b)))
-    int steep = abs(y1 - y0) > abs(x1 - x0);
+static void drawLine(int x0, int y0, int x1, int y1) {
+  #define SWAP_INT(a, b) (((a) ^= (b)), ((b) ^= (a)), ((a) ^= (b)))
+  int steep = abs(y1 - y0) > abs(x1 - x0);
+  if (steep) {
+    SWAP_INT(x0, y0);
+    SWAP_INT(x1, y1);
+  }
+  if (x0 > x1) {
+    SWAP_INT(x0, x1);
+    SWAP_INT(y0, y1);
+  }
+  #undef SWAP_INT
+  int deltax = x1 - x0;
+  int deltay = abs(y1 - y0);
+  int error = deltax / 2;
+  int ystep = (y0 < y1) ? 1 : -1;
+  int x, y = y0;
+  for (x = x0; x < x1; x++) {
     if (steep) {
-      SWAP_INT(x0, y0);
-      SWAP_INT(x1, y1);
-    }
-    if (x0 > x1) {
-      SWAP_INT(x0, x1);
-      SWAP_INT(y0, y1);
+      image_setPixel(graphics_canvas, y, x, graphics_color);
+    } else {
+      image_setPixel(graphics_canvas, x, y, graphics_color);
     }
-    #undef SWAP_INT
-    int deltax = x1 - x0;
-    int deltay = abs(y1 - y0);
-    int error = deltax / 2;
-    int ystep = (y0 < y1) ? 1 : -1;
-    int x, y = y0;
-    for (x = x0; x < x1; x++) {
-      if (steep) {
-        image_setPixel(graphics_canvas, y, x, graphics_color);
-      } else {
-        image_setPixel(graphics_canvas, x, y, graphics_color);
-      }
-      error -= deltay;
-      if (error < 0) {
-        y += ystep;
-        error += deltax;
-      }
+    error -= deltay;
+    if (error < 0) {
+      y += ystep;
+      error += deltax;
     }
-    idx += 2;
   }
-  return 0;
 }
 
 
-int l_graphics_rectangle(lua_State *L) {
-  const char *mode = luaL_checkstring(L, 1);
-  int x = luaL_checknumber(L, 2);
-  int y = luaL_checknumber(L, 3);
-  int x2 = luaL_checknumber(L, 4) + x;
-  int y2 = luaL_checknumber(L, 5) + y;
-  int fill = 0;
-  if (!strcmp(mode, "fill")) {
-    fill = 1;
-  } else if (!strcmp(mode, "line")) {
-    fill = 0;
-  } else {
-    luaL_error(L, "bad mode");
-  }
+static void drawRectangle(int fill, int x, int y, int width, int height) {
+  int x2 = x + width;
+  int y2 = y + height;
+  /* Note which edges are on screen so clipped edges aren't outlined */
+  int left = x >= 0, top = y >= 0;
+  int right = x2 <= graphics_canvas->width;
+  int bottom = y2 <= graphics_canvas->height;
   /* Clip to screen */
-  if (x < 0) { x2 += x; x = 0; }
-  if (y < 0) { y2 += y; y = 0; }
+  if (x < 0) { x = 0; }
+  if (y < 0) { y = 0; }
   if (x2 > graphics_canvas->width)  { x2 = graphics_canvas->width; }
   if (y2 > graphics_canvas->height) { y2 = graphics_canvas->height; }
   /* Get width/height and Abort early if we're off screen */
-  int width = x2 - x;
-  int height = y2 - y;
-  if (width <= 0 || height <= 0) return 0;
+  width = x2 - x;
+  height = y2 - y;
+  if (width <= 0 || height <= 0) return;
   /* Draw */
   if (fill) {
     int i;
     for (i = y; i < y2; i++) {
-      memset(graphics_canvas->data + x + i * graphics_canvas->width,
+      memset(graphics_canvas->data + x + i * graphics_canvas->stride,
              graphics_color, width);
     }
   } else {
-      memset(graphics_canvas->data + x + y * graphics_canvas->width,
-             graphics_color, width);
-      memset(graphics_canvas->data + x + (y2 - 1) * graphics_canvas->width,
-             graphics_color, width);
+      if (top) {
+        memset(graphics_canvas->data + x + y * graphics_canvas->stride,
+               graphics_color, width);
+      }
+      if (bottom) {
+        memset(graphics_canvas->data + x + (y2 - 1) * graphics_canvas->stride,
+               graphics_color, width);
+      }
       int i;
       for (i = y; i < y2; i++) {
-        graphics_canvas->data[x + i * graphics_canvas->width] =
-          graphics_canvas->data[x2 - 1 + i * graphics_canvas->width] =
+        if (left) {
+          graphics_canvas->data[x + i * graphics_canvas->stride] =
             graphics_color;
+        }
+        if (right) {
+          graphics_canvas->data[x2 - 1 + i * graphics_canvas->stride] =
+            graphics_color;
+        }
       }
   }
-  return 0;
 }
 
 
-int l_graphics_circle(lua_State *L) {
-  const char *mode = luaL_checkstring(L, 1);
-  int x = luaL_checknumber(L, 2);
-  int y = luaL_checknumber(L, 3);
-  int radius = luaL_checknumber(L, 4);
-  int fill = 0;
-  if (!strcmp(mode, "fill")) {
-    fill = 1;
-  } else if (!strcmp(mode, "line")) {
-    fill = 0;
-  } else {
-    luaL_error(L, "bad mode");
-  }
-  /* Draw */
+static void drawCircle(int fill, int x, int y, int radius) {
   if (fill) {
     int dx = radius, dy = 0;
     int radiusError = 1-dx;
@@ -396,7 +614,7 @@ int l_graphics_circle(lua_State *L) {
           if (ex < 0) ex = 0;\
           if (ex > graphics_canvas->width) ex = graphics_canvas->width;\
           if (sx == ex) break;\
-          memset(graphics_canvas->data + sx + sy * graphics_canvas->width,\
+          memset(graphics_canvas->data + sx + sy * graphics_canvas->stride,\
                  graphics_color, ex - sx);\
         } while (0)
 
@@ -435,6 +653,392 @@ int l_graphics_circle(lua_State *L) {
       }
     }
   }
+}
+
+
+static int getFillMode(lua_State *L, int idx) {
+  const char *mode = luaL_checkstring(L, idx);
+  if (!strcmp(mode, "fill")) {
+    return 1;
+  } else if (!strcmp(mode, "line")) {
+    return 0;
+  }
+  luaL_error(L, "bad mode");
+  return 0;
+}
+
+
+static drawcmd_t *recordCommand(lua_State *L, int type, int ref) {
+  /* Appends a command to the draw list being recorded, capturing the current
+   * color and blend mode. If `ref` is not 0 the object at that stack index is
+   * kept alive for as long as the list holds the command */
+  if (ref) {
+    ref = lua_absindex(L, ref);
+    lua_pushlightuserdata(L, &graphics_drawList);
+    lua_gettable(L, LUA_REGISTRYINDEX);
+    lua_getuservalue(L, -1);
+    lua_pushvalue(L, ref);
+    lua_pushboolean(L, 1);
+    lua_rawset(L, -3);
+    lua_pop(L, 2);
+  }
+  drawcmd_t *cmd = drawlist_push(graphics_drawList, type);
+  cmd->color[0] = graphics_color_rgb[0];
+  cmd->color[1] = graphics_color_rgb[1];
+  cmd->color[2] = graphics_color_rgb[2];
+  cmd->blendMode = graphics_blendMode;
+  return cmd;
+}
+
+
+static void replayDrawList(lua_State *L, drawlist_t *list, int dx, int dy) {
+  /* Executes each of the list's commands offset by `dx`, `dy`, with the color
+   * and blend mode they were recorded with. Colors are only looked up when
+   * they change from one command to the next */
+  pixel_t color = graphics_color;
+  int i, rgb = -1;
+  for (i = 0; i < list->count; i++) {
+    drawcmd_t *cmd = &list->cmds[i];
+    int x = (int) cmd->x + dx;
+    int y = (int) cmd->y + dy;
+    int c = cmd->color[0] << 16 | cmd->color[1] << 8 | cmd->color[2];
+    if (c != rgb) {
+      int idx = palette_colorToIdx(cmd->color[0], cmd->color[1],
+                                   cmd->color[2]);
+      if (idx < 0) {
+        graphics_color = color;
+        image_setColor(graphics_color);
+        image_setBlendMode(graphics_blendMode);
+        luaL_error(L, "color palette exhausted: use fewer unique colors");
+      }
+      graphics_color = idx;
+      image_setColor(graphics_color);
+      rgb = c;
+    }
+    image_setBlendMode(cmd->blendMode);
+    switch (cmd->type) {
+      case DRAWLIST_IMAGE:
+        drawImage(cmd->u.image.image, cmd->u.image.sx, cmd->u.image.sy,
+                  cmd->u.image.sw, cmd->u.image.sh, cmd->x + dx, cmd->y + dy,
+                  cmd->flag, cmd->u.image.r, cmd->u.image.kx,
+                  cmd->u.image.ky, cmd->u.image.ox, cmd->u.image.oy);
+        break;
+      case DRAWLIST_POINT:
+        image_setPixel(graphics_canvas, x, y, graphics_color);
+        break;
+      case DRAWLIST_LINE:
+        drawLine(x, y, cmd->u.line.x2 + dx, cmd->u.line.y2 + dy);
+        break;
+      case DRAWLIST_RECTANGLE:
+        drawRectangle(cmd->flag, x, y, cmd->u.rect.width, cmd->u.rect.height);
+        break;
+      case DRAWLIST_CIRCLE:
+        drawCircle(cmd->flag, x, y, cmd->u.circle.radius);
+        break;
+      case DRAWLIST_PRINT:
+        font_blit(cmd->u.print.font, graphics_canvas->data,
+                  graphics_canvas->width, graphics_canvas->height,
+                  graphics_canvas->stride, list->text + cmd->u.print.text,
+                  x, y);
+        break;
+    }
+  }
+  graphics_color = color;
+  image_setColor(graphics_color);
+  image_setBlendMode(graphics_blendMode);
+}
+
+
+static void drawParticleSystem(lua_State *L, particlesystem_t *ps,
+                               int dx, int dy
+) {
+  /* The system's colors are looked up each draw rather than when they are set
+   * so that they survive love.graphics.compactPalette() */
+  pixel_t colors[PARTICLESYSTEM_MAX_COLORS];
+  int i;
+  colors[0] = graphics_color;
+  for (i = 0; i < ps->ncolors; i++) {
+    int idx = palette_colorToIdx(ps->colors[i][0], ps->colors[i][1],
+                                 ps->colors[i][2]);
+    if (idx < 0) {
+      luaL_error(L, "color palette exhausted: use fewer unique colors");
+    }
+    colors[i] = idx;
+  }
+  particlesystem_draw(ps, graphics_canvas->data, graphics_canvas->width,
+                      graphics_canvas->height, graphics_canvas->stride,
+                      colors, dx, dy);
+  image_setColor(graphics_color);
+}
+
+
+int l_graphics_draw(lua_State *L) {
+  drawlist_t *list = luaobj_toudata(L, 1, LUAOBJ_TYPE_DRAWLIST);
+  if (list) {
+    if (graphics_drawList) {
+      luaL_error(L, "cannot draw a DrawList while recording");
+    }
+    replayDrawList(L, list, luaL_optnumber(L, 2, 0) + graphics_translate[0],
+                   luaL_optnumber(L, 3, 0) + graphics_translate[1]);
+    return 0;
+  }
+  particlesystem_t *ps = luaobj_toudata(L, 1, LUAOBJ_TYPE_PARTICLESYSTEM);
+  if (ps) {
+    if (graphics_drawList) {
+      luaL_error(L, "cannot draw a ParticleSystem while recording");
+    }
+    drawParticleSystem(L, ps, luaL_optnumber(L, 2, 0) + graphics_translate[0],
+                       luaL_optnumber(L, 3, 0) + graphics_translate[1]);
+    return 0;
+  }
+  image_t *img = luaobj_checkudata(L, 1, LUAOBJ_TYPE_IMAGE);
+  quadrect_t *quad = NULL;
+  int n = 2;
+  int sx = 0, sy = 0, sw = img->width, sh = img->height;
+  if (!lua_isnone(L, 2) && lua_type(L, 2) != LUA_TNUMBER) {
+    quad = luaobj_checkudata(L, 2, LUAOBJ_TYPE_QUAD);
+    sx = quad->x;
+    sy = quad->y;
+    sw = quad->width;
+    sh = quad->height;
+    n = 3;
+  }
+  double x = luaL_optnumber(L, n, 0) + graphics_translate[0];
+  double y = luaL_optnumber(L, n + 1, 0) + graphics_translate[1];
+  int flip = 0;
+  double r = 0, kx = 1, ky = 1, ox = 0, oy = 0;
+  /* A boolean after the position is the legacy horizontal flip argument */
+  if (lua_type(L, n + 2) == LUA_TBOOLEAN) {
+    flip = lua_toboolean(L, n + 2);
+  } else {
+    r = luaL_optnumber(L, n + 2, 0);
+    kx = luaL_optnumber(L, n + 3, 1);
+    ky = luaL_optnumber(L, n + 4, kx);
+    ox = luaL_optnumber(L, n + 5, 0);
+    oy = luaL_optnumber(L, n + 6, 0);
+  }
+  if (graphics_drawList) {
+    drawcmd_t *cmd = recordCommand(L, DRAWLIST_IMAGE, 1);
+    cmd->x = x;
+    cmd->y = y;
+    cmd->flag = flip;
+    cmd->u.image.image = img;
+    cmd->u.image.sx = sx;
+    cmd->u.image.sy = sy;
+    cmd->u.image.sw = sw;
+    cmd->u.image.sh = sh;
+    cmd->u.image.r = r;
+    cmd->u.image.kx = kx;
+    cmd->u.image.ky = ky;
+    cmd->u.image.ox = ox;
+    cmd->u.image.oy = oy;
+    return 0;
+  }
+  drawImage(img, sx, sy, sw, sh, x, y, flip, r, kx, ky, ox, oy);
+  return 0;
+}
+
+
+int l_graphics_drawPerspective(lua_State *L) {
+  image_t *img = luaobj_checkudata(L, 1, LUAOBJ_TYPE_IMAGE);
+  int x = luaL_checknumber(L, 2) + graphics_translate[0];
+  int y = luaL_checknumber(L, 3) + graphics_translate[1];
+  int w = luaL_checknumber(L, 4);
+  int h = luaL_checknumber(L, 5);
+  double camx = luaL_checknumber(L, 6);
+  double camy = luaL_checknumber(L, 7);
+  double angle = luaL_checknumber(L, 8);
+  double height = luaL_checknumber(L, 9);
+  double horizon = luaL_optnumber(L, 10, 0);
+  double focal = luaL_optnumber(L, 11, w / 2.);
+  int wrap = lua_toboolean(L, 12);
+  image_setFlip(0);
+  image_blitPerspective(img, graphics_canvas->data,
+                        graphics_canvas->width, graphics_canvas->height,
+                        graphics_canvas->stride, x, y, w, h, camx, camy,
+                        angle, height, horizon, focal, wrap);
+  return 0;
+}
+
+
+int l_graphics_drawNineSlice(lua_State *L) {
+  image_t *img = luaobj_checkudata(L, 1, LUAOBJ_TYPE_IMAGE);
+  int n = 2;
+  int sx = 0, sy = 0, sw = img->width, sh = img->height;
+  if (lua_type(L, 2) == LUA_TUSERDATA) {
+    quadrect_t *quad = luaobj_checkudata(L, 2, LUAOBJ_TYPE_QUAD);
+    sx = quad->x;
+    sy = quad->y;
+    sw = quad->width;
+    sh = quad->height;
+    luaL_argcheck(L, sx >= 0 && sy >= 0 && sx + sw <= img->width &&
+                  sy + sh <= img->height, 2, "quad exceeds image bounds");
+    n = 3;
+  }
+  /* Insets are a single number or a table of left, top, right, bottom */
+  int i, insets[4];
+  if (lua_istable(L, n)) {
+    for (i = 0; i < 4; i++) {
+      lua_rawgeti(L, n, i + 1);
+      if (!lua_isnumber(L, -1)) {
+        luaL_argerror(L, n, "expected left, top, right and bottom insets");
+      }
+      insets[i] = lua_tonumber(L, -1);
+      lua_pop(L, 1);
+    }
+  } else {
+    insets[0] = insets[1] = insets[2] = insets[3] = luaL_checknumber(L, n);
+  }
+  luaL_argcheck(L, insets[0] >= 0 && insets[1] >= 0 && insets[2] >= 0 &&
+                insets[3] >= 0 && insets[0] + insets[2] <= sw &&
+                insets[1] + insets[3] <= sh, n, "insets exceed image bounds");
+  int x = luaL_checknumber(L, n + 1) + graphics_translate[0];
+  int y = luaL_checknumber(L, n + 2) + graphics_translate[1];
+  int w = luaL_checknumber(L, n + 3);
+  int h = luaL_checknumber(L, n + 4);
+  const char *mode = luaL_optstring(L, n + 5, "stretch");
+  int tile;
+  if (!strcmp(mode, "stretch")) {
+    tile = 0;
+  } else if (!strcmp(mode, "tile")) {
+    tile = 1;
+  } else {
+    return luaL_argerror(L, n + 5, "bad mode");
+  }
+  image_blitNineSlice(img, graphics_canvas->data, graphics_canvas->width,
+                      graphics_canvas->height, graphics_canvas->stride,
+                      x, y, w, h, sx, sy, sw, sh,
+                      insets[0], insets[1], insets[2], insets[3], tile);
+  return 0;
+}
+
+
+static int checkRegion(lua_State *L, int n, image_region_t *r) {
+  /* Reads an `image [, quad], x, y [, flip]` argument sequence starting at
+   * index `n` into the region. Returns the index of the next argument */
+  r->image = luaobj_checkudata(L, n, LUAOBJ_TYPE_IMAGE);
+  r->sx = 0;
+  r->sy = 0;
+  r->sw = r->image->width;
+  r->sh = r->image->height;
+  n++;
+  if (lua_type(L, n) == LUA_TUSERDATA) {
+    quadrect_t *quad = luaobj_checkudata(L, n, LUAOBJ_TYPE_QUAD);
+    r->sx = quad->x;
+    r->sy = quad->y;
+    r->sw = quad->width;
+    r->sh = quad->height;
+    n++;
+  }
+  r->x = luaL_checknumber(L, n);
+  r->y = luaL_checknumber(L, n + 1);
+  n += 2;
+  r->flip = 0;
+  if (lua_type(L, n) == LUA_TBOOLEAN) {
+    r->flip = lua_toboolean(L, n);
+    n++;
+  }
+  return n;
+}
+
+
+int l_graphics_overlaps(lua_State *L) {
+  image_region_t a, b;
+  int x, y;
+  checkRegion(L, checkRegion(L, 1, &a), &b);
+  if (image_overlap(a, b, &x, &y)) {
+    lua_pushinteger(L, x);
+    lua_pushinteger(L, y);
+    return 2;
+  }
+  lua_pushnil(L);
+  return 1;
+}
+
+
+int l_graphics_countOverlap(lua_State *L) {
+  image_region_t a, b;
+  checkRegion(L, checkRegion(L, 1, &a), &b);
+  lua_pushinteger(L, image_overlap(a, b, NULL, NULL));
+  return 1;
+}
+
+
+int l_graphics_point(lua_State *L) {
+  int x = luaL_checknumber(L, 1) + graphics_translate[0];
+  int y = luaL_checknumber(L, 2) + graphics_translate[1];
+  if (graphics_drawList) {
+    drawcmd_t *cmd = recordCommand(L, DRAWLIST_POINT, 0);
+    cmd->x = x;
+    cmd->y = y;
+    return 0;
+  }
+  image_setPixel(graphics_canvas, x, y, graphics_color);
+  return 0;
+}
+
+
+int l_graphics_line(lua_State *L) {
+  int argc = lua_gettop(L);
+  int lastx = luaL_checknumber(L, 1) + graphics_translate[0];
+  int lasty = luaL_checknumber(L, 2) + graphics_translate[1];
+  int idx = 3;
+  while (idx < argc) {
+    int x0 = lastx;
+    int y0 = lasty;
+    int x1 = luaL_checknumber(L, idx) + graphics_translate[0];
+    int y1 = luaL_checknumber(L, idx + 1) + graphics_translate[1];
+    lastx = x1;
+    lasty = y1;
+    if (graphics_drawList) {
+      drawcmd_t *cmd = recordCommand(L, DRAWLIST_LINE, 0);
+      cmd->x = x0;
+      cmd->y = y0;
+      cmd->u.line.x2 = x1;
+      cmd->u.line.y2 = y1;
+    } else {
+      drawLine(x0, y0, x1, y1);
+    }
+    idx += 2;
+  }
+  return 0;
+}
+
+
+int l_graphics_rectangle(lua_State *L) {
+  int fill = getFillMode(L, 1);
+  int x = luaL_checknumber(L, 2) + graphics_translate[0];
+  int y = luaL_checknumber(L, 3) + graphics_translate[1];
+  int width = luaL_checknumber(L, 4);
+  int height = luaL_checknumber(L, 5);
+  if (graphics_drawList) {
+    drawcmd_t *cmd = recordCommand(L, DRAWLIST_RECTANGLE, 0);
+    cmd->x = x;
+    cmd->y = y;
+    cmd->flag = fill;
+    cmd->u.rect.width = width;
+    cmd->u.rect.height = height;
+    return 0;
+  }
+  drawRectangle(fill, x, y, width, height);
+  return 0;
+}
+
+
+int l_graphics_circle(lua_State *L) {
+  int fill = getFillMode(L, 1);
+  int x = luaL_checknumber(L, 2) + graphics_translate[0];
+  int y = luaL_checknumber(L, 3) + graphics_translate[1];
+  int radius = luaL_checknumber(L, 4);
+  if (graphics_drawList) {
+    drawcmd_t *cmd = recordCommand(L, DRAWLIST_CIRCLE, 0);
+    cmd->x = x;
+    cmd->y = y;
+    cmd->flag = fill;
+    cmd->u.circle.radius = radius;
+    return 0;
+  }
+  drawCircle(fill, x, y, radius);
   return 0;
 }
 
@@ -442,10 +1046,21 @@ int l_graphics_circle(lua_State *L) {
 int l_graphics_print(lua_State *L) {
   luaL_checkany(L, 1);
   const char *str = luaL_tolstring(L, 1, NULL);
-  int x = luaL_checknumber(L, 2);
-  int y = luaL_checknumber(L, 3);
+  int x = luaL_checknumber(L, 2) + graphics_translate[0];
+  int y = luaL_checknumber(L, 3) + graphics_translate[1];
+  if (graphics_drawList) {
+    /* Push the font object so the list can keep it alive */
+    lua_pushlightuserdata(L, graphics_font);
+    lua_gettable(L, LUA_REGISTRYINDEX);
+    drawcmd_t *cmd = recordCommand(L, DRAWLIST_PRINT, -1);
+    cmd->x = x;
+    cmd->y = y;
+    cmd->u.print.font = graphics_font;
+    cmd->u.print.text = drawlist_pushText(graphics_drawList, str);
+    return 0;
+  }
   font_blit(graphics_font, graphics_canvas->data, graphics_canvas->width,
-            graphics_canvas->height, str, x, y);
+            graphics_canvas->height, graphics_canvas->stride, str, x, y);
   return 0;
 }
 
@@ -453,8 +1068,12 @@ int l_graphics_print(lua_State *L) {
 
 int l_image_new(lua_State *L);
 int l_image_newCanvas(lua_State *L);
+int l_image_newAtlas(lua_State *L);
 int l_quad_new(lua_State *L);
 int l_font_new(lua_State *L);
+int l_drawlist_new(lua_State *L);
+int l_drawqueue_new(lua_State *L);
+int l_particlesystem_new(lua_State *L);
 
 int luaopen_graphics(lua_State *L) {
   luaL_Reg reg[] = {
@@ -467,14 +1086,33 @@ int luaopen_graphics(lua_State *L) {
     { "setColor",           l_graphics_setColor           },
     { "getBlendMode",       l_graphics_getBlendMode       },
     { "setBlendMode",       l_graphics_setBlendMode       },
+    { "getPaletteMode",     l_graphics_getPaletteMode     },
+    { "setPaletteMode",     l_graphics_setPaletteMode     },
+    { "compactPalette",     l_graphics_compactPalette     },
+    { "getPaletteIndex",    l_graphics_getPaletteIndex    },
+    { "getPaletteEntry",    l_graphics_getPaletteEntry    },
+    { "setPaletteEntry",    l_graphics_setPaletteEntry    },
+    { "cyclePalette",       l_graphics_cyclePalette       },
+    { "fadePalette",        l_graphics_fadePalette        },
+    { "setRemap",           l_graphics_setRemap           },
     { "getFont",            l_graphics_getFont            },
     { "setFont",            l_graphics_setFont            },
     { "getCanvas",          l_graphics_getCanvas          },
     { "setCanvas",          l_graphics_setCanvas          },
+    { "getDrawList",        l_graphics_getDrawList        },
+    { "setDrawList",        l_graphics_setDrawList        },
+    { "push",               l_graphics_push               },
+    { "pop",                l_graphics_pop                },
+    { "translate",          l_graphics_translate          },
+    { "origin",             l_graphics_origin             },
     { "reset",              l_graphics_reset              },
     { "clear",              l_graphics_clear              },
     { "present",            l_graphics_present            },
     { "draw",               l_graphics_draw               },
+    { "drawPerspective",    l_graphics_drawPerspective    },
+    { "drawNineSlice",      l_graphics_drawNineSlice      },
+    { "overlaps",           l_graphics_overlaps           },
+    { "countOverlap",       l_graphics_countOverlap       },
     { "point",              l_graphics_point              },
     { "line",               l_graphics_line               },
     { "rectangle",          l_graphics_rectangle          },
@@ -482,8 +1120,12 @@ int luaopen_graphics(lua_State *L) {
     { "print",              l_graphics_print              },
     { "newImage",           l_image_new                   },
     { "newCanvas",          l_image_newCanvas             },
+    { "newAtlas",           l_image_newAtlas              },
     { "newQuad",            l_quad_new                    },
     { "newFont",            l_font_new                    },
+    { "newDrawList",        l_drawlist_new                },
+    { "newDrawQueue",       l_drawqueue_new               },
+    { "newParticleSystem",  l_particlesystem_new          },
     { 0, 0 },
   };
   luaL_newlib(L, reg);
@@ -5,9 +5,12 @@
  * under the terms of the MIT license. See LICENSE for details.
  */
 
+#include <string.h>
+#include "lib/dmt/dmt.h"
 #include "luaobj.h"
 #include "palette.h"
 #include "image.h"
+#include "atlas.h"
 
 
 #define CLASS_TYPE  LUAOBJ_TYPE_IMAGE
@@ -16,9 +19,12 @@
 
 int l_image_new(lua_State *L) {
   const char *filename = luaL_checkstring(L, 1);
+  int colors = luaL_optnumber(L, 2, 0);
+  int dither = lua_toboolean(L, 3);
+  if (colors < 0) luaL_argerror(L, 2, "colors must not be negative");
   image_t *self = luaobj_newudata(L, sizeof(*self));
   luaobj_setclass(L, CLASS_TYPE, CLASS_NAME);
-  const char *err = image_init(self, filename);
+  const char *err = image_initQuantized(self, filename, colors, dither);
   if (err) luaL_error(L, err);
   return 1;
 }
@@ -40,6 +46,103 @@ int l_image_newCanvas(lua_State *L) {
 }
 
 
+int l_quad_new(lua_State *L);
+
+int l_image_newAtlas(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  int padding = luaL_optnumber(L, 2, 0);
+  int i, j, n = lua_rawlen(L, 1);
+  if (n == 0) luaL_argerror(L, 1, "expected at least one filename");
+  if (padding < 0) luaL_argerror(L, 2, "padding must not be negative");
+  for (i = 0; i < n; i++) {
+    lua_rawgeti(L, 1, i + 1);
+    if (lua_type(L, -1) != LUA_TSTRING) {
+      luaL_argerror(L, 1, "expected table of filenames");
+    }
+    lua_pop(L, 1);
+  }
+
+  /* Load images */
+  image_t *images = dmt_calloc(n, sizeof(*images));
+  atlas_rect_t *rects = dmt_malloc(n * sizeof(*rects));
+  for (i = 0; i < n; i++) {
+    lua_rawgeti(L, 1, i + 1);
+    const char *filename = lua_tostring(L, -1);
+    const char *err = image_init(&images[i], filename);
+    lua_pop(L, 1);
+    if (err) {
+      for (j = 0; j <= i; j++) image_deinit(&images[j]);
+      dmt_free(images);
+      dmt_free(rects);
+      luaL_error(L, "%s: %s", filename, err);
+    }
+    rects[i].width = images[i].width;
+    rects[i].height = images[i].height;
+  }
+
+  /* Pack and copy images into a single image, areas not covered by an image
+   * are transparent */
+  int width, height, area = 0;
+  atlas_pack(rects, n, padding, &width, &height);
+  image_t *self = luaobj_newudata(L, sizeof(*self));
+  luaobj_setclass(L, CLASS_TYPE, CLASS_NAME);
+  image_initBlank(self, width, height);
+  memset(self->mask, 0xff, width * height);
+  for (i = 0; i < n; i++) {
+    image_t *img = &images[i];
+    for (j = 0; j < img->height; j++) {
+      int dsti = rects[i].x + (rects[i].y + j) * self->stride;
+      memcpy(self->data + dsti, img->data + j * img->stride, img->width);
+      memcpy(self->mask + dsti, img->mask + j * img->stride, img->width);
+    }
+    area += img->width * img->height;
+    image_deinit(img);
+  }
+  dmt_free(images);
+
+  /* Make quads table, keyed by filename */
+  lua_createtable(L, 0, n);
+  for (i = 0; i < n; i++) {
+    lua_rawgeti(L, 1, i + 1);
+    lua_pushcfunction(L, l_quad_new);
+    lua_pushinteger(L, rects[i].x);
+    lua_pushinteger(L, rects[i].y);
+    lua_pushinteger(L, rects[i].width);
+    lua_pushinteger(L, rects[i].height);
+    lua_call(L, 4, 1);
+    lua_rawset(L, -3);
+  }
+  dmt_free(rects);
+
+  lua_pushnumber(L, area / (double) (width * height));
+  return 3;
+}
+
+
+int l_image_newView(lua_State *L) {
+  image_t *parent = luaobj_checkudata(L, 1, CLASS_TYPE);
+  int x = luaL_checknumber(L, 2);
+  int y = luaL_checknumber(L, 3);
+  int width = luaL_checknumber(L, 4);
+  int height = luaL_checknumber(L, 5);
+  if (width <= 0) luaL_argerror(L, 4, "width must be larger than 0");
+  if (height <= 0) luaL_argerror(L, 5, "height must be larger than 0");
+  if (x >= parent->width || y >= parent->height ||
+      x + width <= 0 || y + height <= 0) {
+    luaL_error(L, "view rect does not overlap the image");
+  }
+  image_t *self = luaobj_newudata(L, sizeof(*self));
+  luaobj_setclass(L, CLASS_TYPE, CLASS_NAME);
+  image_initView(self, parent, x, y, width, height);
+  /* Keep the parent, which owns the pixels, alive for as long as the view */
+  lua_createtable(L, 1, 0);
+  lua_pushvalue(L, 1);
+  lua_rawseti(L, -2, 1);
+  lua_setuservalue(L, -2);
+  return 1;
+}
+
+
 int l_image_gc(lua_State *L) {
   image_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
   image_deinit(self);
@@ -79,7 +182,7 @@ int l_image_getPixel(lua_State *L) {
     return 1;
   } else {
     /* Return `nil` if color is transparent, else return 3 channel values */
-    int idx = self->data[x + y * self->width];
+    int idx = self->data[x + y * self->stride];
     if (idx == 0) {
       lua_pushnil(L);
       return 1;
@@ -109,7 +212,7 @@ int l_image_setPixel(lua_State *L) {
     int g = luaL_checknumber(L, 5);
     int b = luaL_checknumber(L, 6);
     int idx = palette_colorToIdx(r, g, b);
-    if (idx < -1) {
+    if (idx < 0) {
       luaL_error(L, "color palette exhausted: use fewer unique colors");
     }
     image_setPixel(self, x, y, idx);
@@ -119,6 +222,29 @@ int l_image_setPixel(lua_State *L) {
 }
 
 
+int l_image_scroll(lua_State *L) {
+  image_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  int dx = luaL_checknumber(L, 2);
+  int dy = luaL_checknumber(L, 3);
+  image_copy(self, self, 0, 0, self->width, self->height, dx, dy);
+  return 0;
+}
+
+
+int l_image_copyRegion(lua_State *L) {
+  image_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  image_t *src = luaobj_checkudata(L, 2, CLASS_TYPE);
+  int sx = luaL_checknumber(L, 3);
+  int sy = luaL_checknumber(L, 4);
+  int w = luaL_checknumber(L, 5);
+  int h = luaL_checknumber(L, 6);
+  int dx = luaL_checknumber(L, 7);
+  int dy = luaL_checknumber(L, 8);
+  image_copy(self, src, sx, sy, w, h, dx, dy);
+  return 0;
+}
+
+
 int luaopen_image(lua_State *L) {
   luaL_Reg reg[] = {
     { "new",            l_image_new           },
@@ -128,6 +254,9 @@ int luaopen_image(lua_State *L) {
     { "getHeight",      l_image_getHeight     },
     { "getPixel",       l_image_getPixel      },
     { "setPixel",       l_image_setPixel      },
+    { "newView",        l_image_newView       },
+    { "scroll",         l_image_scroll        },
+    { "copyRegion",     l_image_copyRegion    },
     { 0, 0 },
   };
   luaobj_newclass(L, CLASS_NAME, NULL, l_image_new, reg);
@@ -7,6 +7,7 @@
 
 
 #include "keyboard.h"
+#include "event.h"
 #include "luaobj.h"
 
 
@@ -20,9 +21,10 @@ int l_keyboard_isDown(lua_State *L) {
   int n = lua_gettop(L);
   int res = 0;
   int i;
+  int replaying = event_isReplaying();
   for (i = 1; i <= n; i++) {
     const char *key = luaL_checkstring(L, i);
-    res |= keyboard_isDown(key);
+    res |= replaying ? event_isKeyDown(key) : keyboard_isDown(key);
   }
   lua_pushboolean(L, res);
   return 1;
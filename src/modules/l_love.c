@@ -20,6 +20,10 @@ int luaopen_image(lua_State *L);
 int luaopen_quad(lua_State *L);
 int luaopen_font(lua_State *L);
 int luaopen_source(lua_State *L);
+int luaopen_drawlist(lua_State *L);
+int luaopen_drawqueue(lua_State *L);
+int luaopen_spatialhash(lua_State *L);
+int luaopen_particlesystem(lua_State *L);
 int luaopen_system(lua_State *L);
 int luaopen_event(lua_State *L);
 int luaopen_filesystem(lua_State *L);
@@ -28,6 +32,8 @@ int luaopen_audio(lua_State *L);
 int luaopen_timer(lua_State *L);
 int luaopen_keyboard(lua_State *L);
 int luaopen_mouse(lua_State *L);
+int luaopen_raycast(lua_State *L);
+int luaopen_spatial(lua_State *L);
 
 int luaopen_love(lua_State *L) {
   int i;
@@ -39,6 +45,10 @@ int luaopen_love(lua_State *L) {
     luaopen_quad,
     luaopen_font,
     luaopen_source,
+    luaopen_drawlist,
+    luaopen_drawqueue,
+    luaopen_spatialhash,
+    luaopen_particlesystem,
     NULL,
   };
   for (i = 0; classes[i]; i++) {
@@ -63,6 +73,8 @@ int luaopen_love(lua_State *L) {
     { "timer",      luaopen_timer       },
     { "keyboard",   luaopen_keyboard    },
     { "mouse",      luaopen_mouse       },
+    { "raycast",    luaopen_raycast     },
+    { "spatial",    luaopen_spatial     },
     { 0 },
   };
   for (i = 0; mods[i].name; i++) {
@@ -6,24 +6,35 @@
  */
 
  #include "mouse.h"
+ #include "event.h"
  #include "luaobj.h"
 
 
+static int getX(void) {
+  return event_isReplaying() ? event_getMouseX() : mouse_getX();
+}
+
+
+static int getY(void) {
+  return event_isReplaying() ? event_getMouseY() : mouse_getY();
+}
+
+
 int l_mouse_getPosition(lua_State *L) {
-  lua_pushinteger(L, mouse_getX());
-  lua_pushinteger(L, mouse_getY());
+  lua_pushinteger(L, getX());
+  lua_pushinteger(L, getY());
   return 2;
 }
 
 
 int l_mouse_getX(lua_State *L) {
-  lua_pushinteger(L, mouse_getX());
+  lua_pushinteger(L, getX());
   return 1;
 }
 
 
 int l_mouse_getY(lua_State *L) {
-  lua_pushinteger(L, mouse_getY());
+  lua_pushinteger(L, getY());
   return 1;
 }
 
@@ -35,7 +46,7 @@ int l_mouse_isDown(lua_State *L) {
   for (i = 1; i <= n; i++) {
     int idx = luaL_checknumber(L, i) - 1;
     if (idx >= 0 && idx < MOUSE_BUTTON_MAX) {
-      res |= mouse_isDown(idx);
+      res |= event_isReplaying() ? event_isMouseDown(idx) : mouse_isDown(idx);
     }
   }
   lua_pushboolean(L, res);
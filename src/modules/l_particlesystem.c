@@ -0,0 +1,238 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <string.h>
+
+#include "particlesystem.h"
+#include "quad.h"
+#include "luaobj.h"
+
+
+#define CLASS_TYPE  LUAOBJ_TYPE_PARTICLESYSTEM
+#define CLASS_NAME  "ParticleSystem"
+
+#define MAX_CAPACITY  65536
+
+
+int l_particlesystem_new(lua_State *L) {
+  image_t *img = luaobj_toudata(L, 1, LUAOBJ_TYPE_IMAGE);
+  int n = img ? 2 : 1;
+  quadrect_t *quad = NULL;
+  if (img && !lua_isnone(L, 2) && lua_type(L, 2) != LUA_TNUMBER) {
+    quad = luaobj_checkudata(L, 2, LUAOBJ_TYPE_QUAD);
+    n = 3;
+  }
+  int capacity = luaL_optnumber(L, n, 256);
+  luaL_argcheck(L, capacity > 0 && capacity <= MAX_CAPACITY, n,
+                "capacity out of range");
+  particlesystem_t *self = luaobj_newudata(L, sizeof(*self));
+  luaobj_setclass(L, CLASS_TYPE, CLASS_NAME);
+  particlesystem_init(self, capacity);
+  if (img) {
+    self->image = img;
+    self->sw = img->width;
+    self->sh = img->height;
+    if (quad) {
+      self->sx = quad->x;
+      self->sy = quad->y;
+      self->sw = quad->width;
+      self->sh = quad->height;
+    }
+    /* Keep image alive */
+    lua_newtable(L);
+    lua_pushvalue(L, 1);
+    lua_rawseti(L, -2, 1);
+    lua_setuservalue(L, -2);
+  }
+  return 1;
+}
+
+
+int l_particlesystem_gc(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  particlesystem_deinit(self);
+  return 0;
+}
+
+
+int l_particlesystem_setPosition(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  self->px = luaL_checknumber(L, 2);
+  self->py = luaL_checknumber(L, 3);
+  return 0;
+}
+
+
+int l_particlesystem_getPosition(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  lua_pushnumber(L, self->px);
+  lua_pushnumber(L, self->py);
+  return 2;
+}
+
+
+int l_particlesystem_setEmissionArea(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  const char *str = luaL_checkstring(L, 2);
+  int area;
+  if (!strcmp(str, "none")) {
+    area = PARTICLESYSTEM_AREA_NONE;
+  } else if (!strcmp(str, "rectangle")) {
+    area = PARTICLESYSTEM_AREA_RECTANGLE;
+  } else if (!strcmp(str, "ellipse")) {
+    area = PARTICLESYSTEM_AREA_ELLIPSE;
+  } else if (!strcmp(str, "ring")) {
+    area = PARTICLESYSTEM_AREA_RING;
+  } else {
+    return luaL_argerror(L, 2, "bad emission area");
+  }
+  self->area = area;
+  self->areaw = luaL_optnumber(L, 3, 0);
+  self->areah = luaL_optnumber(L, 4, self->areaw);
+  return 0;
+}
+
+
+int l_particlesystem_setEmissionRate(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  double rate = luaL_checknumber(L, 2);
+  luaL_argcheck(L, rate >= 0, 2, "expected rate of zero or above");
+  self->emissionRate = rate;
+  return 0;
+}
+
+
+int l_particlesystem_setParticleLifetime(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  self->lifeMin = luaL_checknumber(L, 2);
+  self->lifeMax = luaL_optnumber(L, 3, self->lifeMin);
+  return 0;
+}
+
+
+int l_particlesystem_setSpeed(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  self->speedMin = luaL_checknumber(L, 2);
+  self->speedMax = luaL_optnumber(L, 3, self->speedMin);
+  return 0;
+}
+
+
+int l_particlesystem_setDirection(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  self->direction = luaL_checknumber(L, 2);
+  return 0;
+}
+
+
+int l_particlesystem_setSpread(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  self->spread = luaL_checknumber(L, 2);
+  return 0;
+}
+
+
+int l_particlesystem_setLinearAcceleration(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  self->ax = luaL_checknumber(L, 2);
+  self->ay = luaL_checknumber(L, 3);
+  return 0;
+}
+
+
+int l_particlesystem_setColors(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  int i, n = lua_gettop(L) - 1;
+  luaL_argcheck(L, n % 3 == 0, n + 1, "expected red, green and blue values");
+  n /= 3;
+  if (n > PARTICLESYSTEM_MAX_COLORS) {
+    luaL_error(L, "too many colors: the maximum is %d",
+               PARTICLESYSTEM_MAX_COLORS);
+  }
+  for (i = 0; i < n; i++) {
+    self->colors[i][0] = luaL_checknumber(L, 2 + i * 3);
+    self->colors[i][1] = luaL_checknumber(L, 3 + i * 3);
+    self->colors[i][2] = luaL_checknumber(L, 4 + i * 3);
+  }
+  self->ncolors = n;
+  return 0;
+}
+
+
+int l_particlesystem_setSize(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  int w = luaL_checknumber(L, 2);
+  int h = luaL_optnumber(L, 3, w);
+  luaL_argcheck(L, w > 0, 2, "expected width above zero");
+  luaL_argcheck(L, h > 0, 3, "expected height above zero");
+  self->width = w;
+  self->height = h;
+  return 0;
+}
+
+
+int l_particlesystem_emit(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  particlesystem_emit(self, luaL_checknumber(L, 2));
+  return 0;
+}
+
+
+int l_particlesystem_update(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  particlesystem_update(self, luaL_checknumber(L, 2));
+  return 0;
+}
+
+
+int l_particlesystem_reset(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  self->count = 0;
+  self->emitted = 0;
+  return 0;
+}
+
+
+int l_particlesystem_getCount(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  lua_pushinteger(L, self->count);
+  return 1;
+}
+
+
+int l_particlesystem_getBufferSize(lua_State *L) {
+  particlesystem_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  lua_pushinteger(L, self->capacity);
+  return 1;
+}
+
+
+int luaopen_particlesystem(lua_State *L) {
+  luaL_Reg reg[] = {
+    { "new",                    l_particlesystem_new                    },
+    { "__gc",                   l_particlesystem_gc                     },
+    { "setPosition",            l_particlesystem_setPosition            },
+    { "getPosition",            l_particlesystem_getPosition            },
+    { "setEmissionArea",        l_particlesystem_setEmissionArea        },
+    { "setEmissionRate",        l_particlesystem_setEmissionRate        },
+    { "setParticleLifetime",    l_particlesystem_setParticleLifetime    },
+    { "setSpeed",               l_particlesystem_setSpeed               },
+    { "setDirection",           l_particlesystem_setDirection           },
+    { "setSpread",              l_particlesystem_setSpread              },
+    { "setLinearAcceleration",  l_particlesystem_setLinearAcceleration  },
+    { "setColors",              l_particlesystem_setColors              },
+    { "setSize",                l_particlesystem_setSize                },
+    { "emit",                   l_particlesystem_emit                   },
+    { "update",                 l_particlesystem_update                 },
+    { "reset",                  l_particlesystem_reset                  },
+    { "getCount",               l_particlesystem_getCount               },
+    { "getBufferSize",          l_particlesystem_getBufferSize          },
+    { 0, 0 },
+  };
+  luaobj_newclass(L, CLASS_NAME, NULL, l_particlesystem_new, reg);
+  return 1;
+}
@@ -19,7 +19,7 @@
 
 
 int l_quad_new(lua_State *L) {
-  quad_t *self = luaobj_newudata(L, sizeof(*self));
+  quadrect_t *self = luaobj_newudata(L, sizeof(*self));
   luaobj_setclass(L, CLASS_TYPE, CLASS_NAME);
   self->x = luaL_checknumber(L, 1);
   self->y = luaL_checknumber(L, 2);
@@ -30,7 +30,7 @@ int l_quad_new(lua_State *L) {
 
 
 int l_quad_setViewport(lua_State *L) {
-  quad_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  quadrect_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
   self->x = luaL_checknumber(L, 2);
   self->y = luaL_checknumber(L, 3);
   self->width = luaL_checknumber(L, 4);
@@ -40,7 +40,7 @@ int l_quad_setViewport(lua_State *L) {
 
 
 int l_quad_getViewport(lua_State *L) {
-  quad_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  quadrect_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
   lua_pushnumber(L, self->x);
   lua_pushnumber(L, self->y);
   lua_pushnumber(L, self->width);
@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <math.h>
+#include "luaobj.h"
+#include "image.h"
+#include "raycast.h"
+
+#define MAX_TEXTURES  255
+
+extern image_t *graphics_canvas;
+
+/* The z-buffer table returned by render() and the buffer it is filled from
+ * are reused between calls so that drawing a frame creates no garbage; the
+ * buffer is a userdata which is only replaced when the canvas is wider */
+int raycast_zbufRef = LUA_NOREF;
+int raycast_zbufLen;
+int raycast_bufRef = LUA_NOREF;
+int raycast_bufCap;
+
+
+int l_raycast_render(lua_State *L) {
+  size_t len;
+  const char *map = luaL_checklstring(L, 1, &len);
+  int mapw = luaL_checknumber(L, 2);
+  luaL_checktype(L, 3, LUA_TTABLE);
+  double x = luaL_checknumber(L, 4);
+  double y = luaL_checknumber(L, 5);
+  double angle = luaL_checknumber(L, 6);
+  double fov = luaL_optnumber(L, 7, M_PI / 3);
+  double shade = luaL_optnumber(L, 8, 0);
+  luaL_argcheck(L, mapw > 0 && len % mapw == 0, 2,
+                "map length must be a multiple of its width");
+  luaL_argcheck(L, fov > 0 && fov < M_PI, 7, "expected fov between 0 and pi");
+
+  /* Get textures */
+  image_t *textures[MAX_TEXTURES];
+  int i, ntextures = lua_rawlen(L, 3);
+  if (ntextures > MAX_TEXTURES) {
+    luaL_error(L, "too many textures: the maximum is %d", MAX_TEXTURES);
+  }
+  for (i = 0; i < ntextures; i++) {
+    lua_rawgeti(L, 3, i + 1);
+    luaobj_head_t *udata = lua_touserdata(L, -1);
+    if (!udata || !(udata->type & LUAOBJ_TYPE_IMAGE)) {
+      luaL_error(L, "bad texture #%d: expected Image", i + 1);
+    }
+    textures[i] = (image_t*) (udata + 1);
+    if (textures[i]->width <= 0 || textures[i]->height <= 0) {
+      luaL_error(L, "bad texture #%d: expected non-empty Image", i + 1);
+    }
+    lua_pop(L, 1);
+  }
+
+  /* Get z-buffer */
+  int w = graphics_canvas->width;
+  if (w > raycast_bufCap) {
+    luaL_unref(L, LUA_REGISTRYINDEX, raycast_bufRef);
+    lua_newuserdata(L, w * sizeof(double));
+    raycast_bufRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    raycast_bufCap = w;
+  }
+  lua_rawgeti(L, LUA_REGISTRYINDEX, raycast_bufRef);
+  double *zbuf = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  /* Render */
+  raycast_render(graphics_canvas->data, w, graphics_canvas->height,
+                 graphics_canvas->stride, (const unsigned char*) map,
+                 mapw, len / mapw, textures, ntextures, x, y, angle, fov,
+                 shade, zbuf);
+
+  /* Fill z-buffer table, clearing entries left over from a wider canvas */
+  if (raycast_zbufRef == LUA_NOREF) {
+    lua_newtable(L);
+    raycast_zbufRef = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  lua_rawgeti(L, LUA_REGISTRYINDEX, raycast_zbufRef);
+  for (i = 0; i < w; i++) {
+    lua_pushnumber(L, zbuf[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  for (; i < raycast_zbufLen; i++) {
+    lua_pushnil(L);
+    lua_rawseti(L, -2, i + 1);
+  }
+  raycast_zbufLen = w;
+  return 1;
+}
+
+
+int luaopen_raycast(lua_State *L) {
+  luaL_Reg reg[] = {
+    { "render",           l_raycast_render          },
+    { 0, 0 },
+  };
+  luaL_newlib(L, reg);
+  return 1;
+}
@@ -0,0 +1,224 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "spatial.h"
+#include "luaobj.h"
+
+
+#define CLASS_TYPE  LUAOBJ_TYPE_SPATIALHASH
+#define CLASS_NAME  "SpatialHash"
+
+typedef struct {
+  spatial_t spatial;
+  int resultLen;
+} spatialhash_t;
+
+
+static int checkId(lua_State *L, int idx) {
+  int id = luaL_checkinteger(L, idx);
+  luaL_argcheck(L, id >= 0 && id < SPATIAL_MAX_ID, idx, "id out of range");
+  return id;
+}
+
+
+static int pushResults(lua_State *L, spatialhash_t *self,
+                       const int *results, int n
+) {
+  /* Fills the hash's results table, clearing entries left over from a larger
+   * query, and pushes it followed by the number of results */
+  int i;
+  lua_getuservalue(L, 1);
+  for (i = 0; i < n; i++) {
+    lua_pushinteger(L, results[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  for (; i < self->resultLen; i++) {
+    lua_pushnil(L);
+    lua_rawseti(L, -2, i + 1);
+  }
+  self->resultLen = n;
+  lua_pushinteger(L, n);
+  return 2;
+}
+
+
+int l_spatialhash_new(lua_State *L) {
+  float cellSize = luaL_optnumber(L, 1, 32);
+  luaL_argcheck(L, cellSize > 0, 1, "expected cell size above zero");
+  spatialhash_t *self = luaobj_newudata(L, sizeof(*self));
+  luaobj_setclass(L, CLASS_TYPE, CLASS_NAME);
+  spatial_init(&self->spatial, cellSize);
+  self->resultLen = 0;
+  /* The uservalue table is returned by each query so that querying every
+   * frame creates no garbage */
+  lua_newtable(L);
+  lua_setuservalue(L, -2);
+  return 1;
+}
+
+
+int l_spatialhash_gc(lua_State *L) {
+  spatialhash_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  spatial_deinit(&self->spatial);
+  return 0;
+}
+
+
+int l_spatialhash_insert(lua_State *L) {
+  spatialhash_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  int id = checkId(L, 2);
+  float x = luaL_checknumber(L, 3);
+  float y = luaL_checknumber(L, 4);
+  float w = luaL_optnumber(L, 5, 0);
+  float h = luaL_optnumber(L, 6, 0);
+  luaL_argcheck(L, w >= 0, 5, "expected width of zero or above");
+  luaL_argcheck(L, h >= 0, 6, "expected height of zero or above");
+  spatial_insert(&self->spatial, id, x, y, w, h);
+  return 0;
+}
+
+
+int l_spatialhash_move(lua_State *L) {
+  spatialhash_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  int id = checkId(L, 2);
+  float x = luaL_checknumber(L, 3);
+  float y = luaL_checknumber(L, 4);
+  spatial_item_t *it = spatial_get(&self->spatial, id);
+  if (!it) {
+    luaL_error(L, "id %d is not in the hash", id);
+  }
+  float w = luaL_optnumber(L, 5, it->w);
+  float h = luaL_optnumber(L, 6, it->h);
+  luaL_argcheck(L, w >= 0, 5, "expected width of zero or above");
+  luaL_argcheck(L, h >= 0, 6, "expected height of zero or above");
+  spatial_move(&self->spatial, id, x, y, w, h);
+  return 0;
+}
+
+
+int l_spatialhash_remove(lua_State *L) {
+  spatialhash_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  int id = checkId(L, 2);
+  lua_pushboolean(L, spatial_remove(&self->spatial, id) == 0);
+  return 1;
+}
+
+
+int l_spatialhash_update(lua_State *L) {
+  spatialhash_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  luaL_checktype(L, 3, LUA_TTABLE);
+  luaL_checktype(L, 4, LUA_TTABLE);
+  int i, n = lua_rawlen(L, 2);
+  for (i = 1; i <= n; i++) {
+    lua_rawgeti(L, 2, i);
+    lua_rawgeti(L, 3, i);
+    lua_rawgeti(L, 4, i);
+    if (!lua_isnumber(L, -3) || !lua_isnumber(L, -2) || !lua_isnumber(L, -1)) {
+      luaL_error(L, "bad entry #%d: expected numbers", i);
+    }
+    int id = lua_tointeger(L, -3);
+    float x = lua_tonumber(L, -2);
+    float y = lua_tonumber(L, -1);
+    spatial_item_t *it = spatial_get(&self->spatial, id);
+    if (!it) {
+      luaL_error(L, "bad entry #%d: id %d is not in the hash", i, id);
+    }
+    spatial_move(&self->spatial, id, x, y, it->w, it->h);
+    lua_pop(L, 3);
+  }
+  return 0;
+}
+
+
+int l_spatialhash_query(lua_State *L) {
+  spatialhash_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  float x = luaL_checknumber(L, 2);
+  float y = luaL_checknumber(L, 3);
+  float w = luaL_checknumber(L, 4);
+  float h = luaL_checknumber(L, 5);
+  const int *results;
+  int n = spatial_query(&self->spatial, x, y, w, h, &results);
+  return pushResults(L, self, results, n);
+}
+
+
+int l_spatialhash_queryPoint(lua_State *L) {
+  spatialhash_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  float x = luaL_checknumber(L, 2);
+  float y = luaL_checknumber(L, 3);
+  const int *results;
+  int n = spatial_query(&self->spatial, x, y, 0, 0, &results);
+  return pushResults(L, self, results, n);
+}
+
+
+int l_spatialhash_has(lua_State *L) {
+  spatialhash_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  spatial_item_t *item = spatial_get(&self->spatial, luaL_checkinteger(L, 2));
+  lua_pushboolean(L, item != NULL);
+  return 1;
+}
+
+
+int l_spatialhash_getRect(lua_State *L) {
+  spatialhash_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  spatial_item_t *it = spatial_get(&self->spatial, luaL_checkinteger(L, 2));
+  if (!it) {
+    return 0;
+  }
+  lua_pushnumber(L, it->x);
+  lua_pushnumber(L, it->y);
+  lua_pushnumber(L, it->w);
+  lua_pushnumber(L, it->h);
+  return 4;
+}
+
+
+int l_spatialhash_clear(lua_State *L) {
+  spatialhash_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  spatial_clear(&self->spatial);
+  return 0;
+}
+
+
+int l_spatialhash_getCount(lua_State *L) {
+  spatialhash_t *self = luaobj_checkudata(L, 1, CLASS_TYPE);
+  lua_pushinteger(L, self->spatial.count);
+  return 1;
+}
+
+
+int luaopen_spatialhash(lua_State *L) {
+  luaL_Reg reg[] = {
+    { "new",          l_spatialhash_new         },
+    { "__gc",         l_spatialhash_gc          },
+    { "insert",       l_spatialhash_insert      },
+    { "move",         l_spatialhash_move        },
+    { "remove",       l_spatialhash_remove      },
+    { "update",       l_spatialhash_update      },
+    { "query",        l_spatialhash_query       },
+    { "queryPoint",   l_spatialhash_queryPoint  },
+    { "has",          l_spatialhash_has         },
+    { "getRect",      l_spatialhash_getRect     },
+    { "clear",        l_spatialhash_clear       },
+    { "getCount",     l_spatialhash_getCount    },
+    { 0, 0 },
+  };
+  luaobj_newclass(L, CLASS_NAME, NULL, l_spatialhash_new, reg);
+  return 1;
+}
+
+
+int luaopen_spatial(lua_State *L) {
+  luaL_Reg reg[] = {
+    { "newHash",      l_spatialhash_new         },
+    { 0, 0 },
+  };
+  luaL_newlib(L, reg);
+  return 1;
+}
@@ -5,15 +5,13 @@
  * under the terms of the MIT license. See LICENSE for details.
  */
 
-#include <dos.h>
-#include <time.h>
 #include "lib/dmt/dmt.h"
 #include "luaobj.h"
-#include "vga.h"
+#include "platform.h"
 
 
 int l_system_getOS(lua_State *L) {
-  lua_pushstring(L, "DOS");
+  lua_pushstring(L, platform_getOS());
   return 1;
 }
 
@@ -5,32 +5,42 @@
  * under the terms of the MIT license. See LICENSE for details.
  */
 
-#include <dos.h>
-#include <time.h>
 #include "luaobj.h"
+#include "platform.h"
+#include "event.h"
 #include "image.h"
+#include "palette.h"
 #include "vga.h"
 
-long long timer_lastStep;
+double timer_lastStep;
 double timer_lastDt;
 
 double  timer_avgLastDt;
 double  timer_avgAcc = 1;
 int     timer_avgCount;
 double  timer_avgTimer;
+double  timer_fixedDt;
 
 
 int l_timer_step(lua_State *L) {
   /* Do delta */
-  long long now;
-  /* Sometimes a call to uclock() will return a slightly earlier time than the
-   * previous call, resulting in a negative delta time. The below loop keeps
-   * trying for a proper value if this occurs. */
-  do {
-    now = uclock();
-    timer_lastDt = (now - timer_lastStep) / (double) UCLOCKS_PER_SEC;
-  } while (timer_lastDt < 0);
-  timer_lastStep = now;
+  double now;
+  if (timer_fixedDt > 0) {
+    timer_lastDt = timer_fixedDt;
+  } else {
+    /* Sometimes the DOS clock will return a slightly earlier time than the
+     * previous call, resulting in a negative delta time. The below loop keeps
+     * trying for a proper value if this occurs. */
+    do {
+      now = platform_getTime();
+      timer_lastDt = now - timer_lastStep;
+    } while (timer_lastDt < 0);
+    timer_lastStep = now;
+  }
+  /* Recorded sessions log the delta, replayed sessions take it from the log */
+  timer_lastDt = event_step(timer_lastDt);
+  /* Advance palette effects */
+  palette_update(timer_lastDt);
   /* Do average */
   timer_avgAcc += timer_lastDt;
   timer_avgCount++;
@@ -46,7 +56,7 @@ int l_timer_step(lua_State *L) {
 
 
 int l_timer_sleep(lua_State *L) {
-  delay(luaL_checknumber(L, 1) * 1000.);
+  platform_sleep(luaL_checknumber(L, 1));
   return 1;
 }
 
@@ -70,7 +80,7 @@ int l_timer_getFPS(lua_State *L) {
 
 
 int l_timer_getTime(lua_State *L) {
-  lua_pushnumber(L, uclock() / (double) UCLOCKS_PER_SEC);
+  lua_pushnumber(L, platform_getTime());
   return 1;
 }
 
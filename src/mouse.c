@@ -5,6 +5,8 @@
  * under the terms of the MIT license. See LICENSE for details.
  */
 
+#ifdef __DJGPP__
+
 #include <stdlib.h>
 #include <string.h>
 #include <dos.h>
@@ -90,3 +92,5 @@ int mouse_getX(void) {
 int mouse_getY(void) {
   return mouse_y;
 }
+
+#endif
@@ -0,0 +1,38 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef __DJGPP__
+
+#include "mouse.h"
+
+/* Headless mouse backend for host builds: there is no mouse, so it stays at
+ * the top-left of the screen with no buttons down */
+
+
+void mouse_init(void) {
+}
+
+
+void mouse_update(void) {
+}
+
+
+int mouse_isDown(int button) {
+  return 0;
+}
+
+
+int mouse_getX(void) {
+  return 0;
+}
+
+
+int mouse_getY(void) {
+  return 0;
+}
+
+#endif
@@ -6,19 +6,64 @@
  */
 
 #include <stdlib.h>
-#include <pc.h>
+#include <string.h>
+#include <math.h>
 
+#include "lib/dmt/dmt.h"
 #include "palette.h"
 #include "vga.h"
 
 #define MAX_IDX   256
-#define MAP_SIZE  1024
-#define MAP_MASK  (MAP_SIZE - 1)
+#define MAP_SIZE  (1 << 15)
 
-struct { unsigned color; int idx; } palette_map[MAP_SIZE];
+#define MAX_CYCLES  8
+
+#define INVERSE_BITS  5
+#define INVERSE_SIZE  (1 << (INVERSE_BITS * 3))
+
+/* Maps a 24bit color to its 15bit table key */
+#define MAP_KEY(color)\
+  ((((color) >> 9) & 0x7c00) | (((color) >> 6) & 0x3e0) |\
+   (((color) >> 3) & 0x1f))
+
+/* Colors are found through a table indexed directly by their 15bit key, each
+ * entry holding the first idx whose color has that key (0 for none).
+ * Distinct colors sharing a key are chained through palette_mapNext */
+unsigned char palette_map[MAP_SIZE];
+unsigned char palette_mapNext[MAX_IDX];
 unsigned palette_palette[MAX_IDX];
 int palette_nextIdx;
+int palette_dirtyMin = MAX_IDX;
+int palette_dirtyMax = -1;
 int palette_inited;
+int palette_mode = PALETTE_EXACT;
+
+/* Effects applied when the palette is uploaded to the system palette; the
+ * colors in palette_palette are never changed by them */
+struct { int first, last; double speed, offset; } palette_cycles[MAX_CYCLES];
+unsigned palette_fadeTarget[MAX_IDX];
+char palette_fadeHas[MAX_IDX];
+double palette_fadeAmount;
+double palette_fadeGoal;
+double palette_fadeSpeed;
+
+/* Blend tables: for each mode, maps (src << 8 | dst) to the idx nearest to
+ * the blended color. Built lazily and rebuilt once the palette has changed */
+unsigned char *palette_blendTables[PALETTE_BLEND_MAX];
+unsigned palette_blendVersions[PALETTE_BLEND_MAX];
+unsigned palette_version = 1;
+
+/* Shade table: maps (level << 8 | idx) to the idx nearest to the color darkened
+ * by the level, built lazily like the blend tables */
+unsigned char palette_shadeTable[PALETTE_SHADE_LEVELS * MAX_IDX];
+unsigned palette_shadeVersion;
+
+/* Inverse colormap: maps each 15bit rgb cell to its nearest palette idx. It
+ * is brought up to date lazily by applying only the palette entries which
+ * were added since the last lookup */
+unsigned char palette_inverse[INVERSE_SIZE];
+unsigned palette_inverseDist[INVERSE_SIZE];
+int palette_inverseCount;
 
 
 void palette_init(void) {
@@ -28,24 +73,220 @@ void palette_init(void) {
 }
 
 
+void palette_deinit(void) {
+  int i;
+  for (i = 0; i < PALETTE_BLEND_MAX; i++) {
+    dmt_free(palette_blendTables[i]);
+    palette_blendTables[i] = NULL;
+  }
+}
+
+
 void palette_reset(void) {
   /* Reset nextIdx -- start at idx 1 as 0 is used for transparency */
   palette_nextIdx = 1;
+  palette_version++;
   /* Reset palette_map */
+  memset(palette_map, 0, sizeof(palette_map));
+  /* Reset inverse colormap -- it is rebuilt on the next nearest lookup */
+  palette_inverseCount = 1;
+}
+
+
+void palette_setMode(int mode) {
+  palette_mode = mode;
+}
+
+
+int palette_getMode(void) {
+  return palette_mode;
+}
+
+
+int palette_getFree(void) {
+  palette_init();
+  return MAX_IDX - palette_nextIdx;
+}
+
+
+static void markDirty(int first, int last) {
+  if (first < palette_dirtyMin) palette_dirtyMin = first;
+  if (last > palette_dirtyMax) palette_dirtyMax = last;
+}
+
+
+static unsigned displayColor(int idx) {
+  /* Returns the color of the idx with the cycle and fade effects applied */
+  int i, src = idx;
+  for (i = 0; i < MAX_CYCLES; i++) {
+    if (palette_cycles[i].speed != 0 &&
+        idx >= palette_cycles[i].first && idx <= palette_cycles[i].last
+    ) {
+      int len = palette_cycles[i].last - palette_cycles[i].first + 1;
+      int shift = (int) palette_cycles[i].offset % len;
+      src = palette_cycles[i].first +
+            (idx - palette_cycles[i].first - shift + len) % len;
+      break;
+    }
+  }
+  unsigned color = palette_palette[src];
+  if (palette_fadeAmount > 0 && palette_fadeHas[idx]) {
+    unsigned target = palette_fadeTarget[idx];
+    int t = palette_fadeAmount * 256;
+    unsigned res = 0;
+    for (i = 0; i < 24; i += 8) {
+      int a = (color >> i) & 0xff;
+      int b = (target >> i) & 0xff;
+      res |= ((a + (((b - a) * t) >> 8)) & 0xff) << i;
+    }
+    color = res;
+  }
+  return color;
+}
+
+
+void palette_flush(void) {
+  /* Uploads the range of palette entries changed since the last flush to the
+   * system palette in a single write */
+  if (palette_dirtyMin > palette_dirtyMax) {
+    return;
+  }
+  unsigned colors[MAX_IDX];
+  int i;
+  int count = palette_dirtyMax - palette_dirtyMin + 1;
+  for (i = 0; i < count; i++) {
+    colors[i] = displayColor(palette_dirtyMin + i);
+  }
+  vga_setPaletteRange(palette_dirtyMin, count, colors);
+  palette_dirtyMin = MAX_IDX;
+  palette_dirtyMax = -1;
+}
+
+
+void palette_update(double dt) {
+  /* Advances the palette cycles and fade, marking any entries whose displayed
+   * color changed */
   int i;
-  for (i = 0; i < MAP_SIZE; i++) {
-    palette_map[i].idx = -1;
+  for (i = 0; i < MAX_CYCLES; i++) {
+    if (palette_cycles[i].speed == 0) continue;
+    int len = palette_cycles[i].last - palette_cycles[i].first + 1;
+    int last = palette_cycles[i].offset;
+    double offset = palette_cycles[i].offset + palette_cycles[i].speed * dt;
+    /* Keep offset positive and in the range of the cycle's length */
+    offset = fmod(offset, len);
+    if (offset < 0) offset += len;
+    palette_cycles[i].offset = offset;
+    if ((int) offset != last) {
+      markDirty(palette_cycles[i].first, palette_cycles[i].last);
+    }
+  }
+  if (palette_fadeAmount != palette_fadeGoal) {
+    double step = palette_fadeSpeed * dt;
+    if (palette_fadeAmount < palette_fadeGoal) {
+      palette_fadeAmount += step;
+      if (palette_fadeAmount > palette_fadeGoal) {
+        palette_fadeAmount = palette_fadeGoal;
+      }
+    } else {
+      palette_fadeAmount -= step;
+      if (palette_fadeAmount < palette_fadeGoal) {
+        palette_fadeAmount = palette_fadeGoal;
+      }
+    }
+    markDirty(0, MAX_IDX - 1);
+  }
+}
+
+
+int palette_cycle(int first, int last, double speed) {
+  /* Sets the speed in entries per second at which the range of entries is
+   * rotated, replacing any cycle on the same range. A speed of 0 stops the
+   * cycle and restores the entries. Returns -1 if there are too many cycles */
+  int i, slot = -1;
+  for (i = 0; i < MAX_CYCLES; i++) {
+    if (palette_cycles[i].first == first && palette_cycles[i].last == last &&
+        palette_cycles[i].speed != 0
+    ) {
+      slot = i;
+      break;
+    }
+    if (slot < 0 && palette_cycles[i].speed == 0) {
+      slot = i;
+    }
+  }
+  if (speed == 0) {
+    if (slot >= 0 && palette_cycles[slot].speed != 0) {
+      palette_cycles[slot].speed = 0;
+      markDirty(first, last);
+    }
+    return 0;
   }
+  if (slot < 0) {
+    return -1;
+  }
+  if (palette_cycles[slot].speed == 0) {
+    palette_cycles[slot].offset = 0;
+  }
+  palette_cycles[slot].first = first;
+  palette_cycles[slot].last = last;
+  palette_cycles[slot].speed = speed;
+  return 0;
 }
 
 
-static unsigned hash(const void *data, int size) {
-  unsigned hash = 5381;
-  const unsigned char *p = data;
-  while (size--) {
-    hash = ((hash << 5) + hash) ^ *p++;
+void palette_fade(double duration, const unsigned *target, const char *has) {
+  /* Fades the displayed palette over `duration` seconds toward the `target`
+   * colors of the entries flagged in `has`. If `target` is NULL the displayed
+   * palette is faded back to the normal colors */
+  if (target) {
+    memcpy(palette_fadeTarget, target, sizeof(palette_fadeTarget));
+    memcpy(palette_fadeHas, has, sizeof(palette_fadeHas));
+    palette_fadeGoal = 1;
+  } else {
+    palette_fadeGoal = 0;
   }
-  return hash;
+  if (duration > 0) {
+    palette_fadeSpeed = 1. / duration;
+  } else {
+    palette_fadeAmount = palette_fadeGoal;
+  }
+  markDirty(0, MAX_IDX - 1);
+}
+
+
+int palette_setColor(int idx, int r, int g, int b) {
+  /* Changes the color of an existing palette entry, everything drawn using it
+   * changes color. Returns -1 if the idx is not in use */
+  palette_init();
+  if (idx <= 0 || idx >= palette_nextIdx) {
+    return -1;
+  }
+  /* Remove idx from its old key's chain */
+  unsigned char *p = &palette_map[MAP_KEY(palette_palette[idx])];
+  while (*p != idx) {
+    p = &palette_mapNext[*p];
+  }
+  *p = palette_mapNext[idx];
+  /* Set color and add to the new key's chain */
+  unsigned color = ((b  & 0xff) << 16) | ((g & 0xff) << 8) | (r & 0xff);
+  int key = MAP_KEY(color);
+  palette_palette[idx] = color;
+  palette_mapNext[idx] = palette_map[key];
+  palette_map[key] = idx;
+  markDirty(idx, idx);
+  palette_inverseCount = 1;
+  palette_version++;
+  return 0;
+}
+
+
+static int findIdx(unsigned color) {
+  /* Returns the idx of the 24bit color, or 0 if it is not in the palette */
+  int i = palette_map[MAP_KEY(color)];
+  while (i && palette_palette[i] != color) {
+    i = palette_mapNext[i];
+  }
+  return i;
 }
 
 
@@ -55,37 +296,220 @@ int palette_colorToIdx(int r, int g, int b) {
   /* Make 24bit rgb color */
   unsigned color = ((b  & 0xff) << 16) | ((g & 0xff) << 8) | (r & 0xff);
 
-  /* Hash color */
-  unsigned h = hash(&color, sizeof(color));
-
-  /* Find color in hashmap */
-  int i = h & MAP_MASK;
-  while (palette_map[i].idx != -1) {
-    if (palette_map[i].color == color) {
-      return palette_map[i].idx;
-    }
-    i = (i + 1) & MAP_MASK;
+  /* Find color in map */
+  int i = findIdx(color);
+  if (i) {
+    return i;
   }
+  int key = MAP_KEY(color);
 
-  /* Color wasn't found in hashmap -- Add to system palette and map */
+  /* Color wasn't found in map -- Add to system palette and map */
   if (palette_nextIdx >= MAX_IDX) {
-    return -1;  /* Return -1 for error if we've exceeded the palette capacity */
+    /* If we've exceeded the palette capacity we either fall back to the
+     * nearest existing color or return -1 for error */
+    if (palette_mode == PALETTE_NEAREST) {
+      return palette_nearestIdx(r, g, b);
+    }
+    return -1;
   }
   int idx = palette_nextIdx++;
 
   /* Update internal palette table */
   palette_palette[idx] = color;
+  palette_version++;
 
-  /* Update system palette */
-  vga_setPalette(idx, r, g, b);
+  /* Mark for upload to the system palette */
+  markDirty(idx, idx);
 
-  /* Add to hashmap and return idx */
-  palette_map[i].color = color;
-  palette_map[i].idx = idx;
+  /* Add to the front of the key's chain and return idx */
+  palette_mapNext[idx] = palette_map[key];
+  palette_map[key] = idx;
   return idx;
 }
 
 
+static void updateInverse(void) {
+  int i, r, g, b;
+  if (palette_inverseCount <= 1) {
+    memset(palette_inverse, 0, sizeof(palette_inverse));
+    memset(palette_inverseDist, 0xff, sizeof(palette_inverseDist));
+  }
+  /* Apply each palette entry added since the last update to every cell whose
+   * center is closer to it than to the cell's current nearest entry */
+  for (; palette_inverseCount < palette_nextIdx; palette_inverseCount++) {
+    int idx = palette_inverseCount;
+    unsigned color = palette_palette[idx];
+    unsigned dr[32], dg[32], db[32];
+    for (i = 0; i < 32; i++) {
+      int c = (i << 3) + 4;
+      int d;
+      d = c - (int) ((color      ) & 0xff); dr[i] = d * d;
+      d = c - (int) ((color >>  8) & 0xff); dg[i] = d * d;
+      d = c - (int) ((color >> 16) & 0xff); db[i] = d * d;
+    }
+    i = 0;
+    for (b = 0; b < 32; b++) {
+      for (g = 0; g < 32; g++) {
+        unsigned dbg = db[b] + dg[g];
+        for (r = 0; r < 32; r++, i++) {
+          unsigned d = dbg + dr[r];
+          if (d < palette_inverseDist[i]) {
+            palette_inverseDist[i] = d;
+            palette_inverse[i] = idx;
+          }
+        }
+      }
+    }
+  }
+}
+
+
+int palette_nearestIdx(int r, int g, int b) {
+  palette_init();
+
+  /* Return -1 for error if there are no colors to choose from */
+  if (palette_nextIdx <= 1) {
+    return -1;
+  }
+
+  /* Bring the inverse colormap up to date and look up the color's cell */
+  if (palette_inverseCount < palette_nextIdx) {
+    updateInverse();
+  }
+  unsigned color = ((b  & 0xff) << 16) | ((g & 0xff) << 8) | (r & 0xff);
+  return palette_inverse[MAP_KEY(color)];
+}
+
+
+int palette_compact(const char *used, unsigned char *remap) {
+  /* Moves every palette entry flagged in `used` down to the lowest free idx,
+   * freeing all the others. `remap` is filled with each old idx's new idx (0
+   * for freed entries). Returns the number of freed entries */
+  palette_init();
+  int i, n = 1;
+  remap[0] = 0;
+  for (i = 1; i < MAX_IDX; i++) {
+    if (i < palette_nextIdx && used[i]) {
+      palette_palette[n] = palette_palette[i];
+      remap[i] = n++;
+    } else {
+      remap[i] = 0;
+    }
+  }
+  int freed = palette_nextIdx - n;
+  palette_nextIdx = n;
+
+  /* Move fade targets along with their entries, clearing those of the freed
+   * entries; cycles are index ranges which no longer hold together so they
+   * are stopped */
+  for (i = 1; i < MAX_IDX; i++) {
+    if (remap[i]) {
+      palette_fadeTarget[remap[i]] = palette_fadeTarget[i];
+      palette_fadeHas[remap[i]] = palette_fadeHas[i];
+    }
+  }
+  for (i = n; i < MAX_IDX; i++) {
+    palette_fadeHas[i] = 0;
+  }
+  for (i = 0; i < MAX_CYCLES; i++) {
+    palette_cycles[i].speed = 0;
+  }
+
+  /* Rebuild map and system palette */
+  memset(palette_map, 0, sizeof(palette_map));
+  for (i = 1; i < palette_nextIdx; i++) {
+    unsigned color = palette_palette[i];
+    int key = MAP_KEY(color);
+    palette_mapNext[i] = palette_map[key];
+    palette_map[key] = i;
+  }
+  markDirty(0, MAX_IDX - 1);
+  palette_inverseCount = 1;
+  palette_version++;
+
+  return freed;
+}
+
+
+static unsigned blendColor(int mode, unsigned src, unsigned dst) {
+  unsigned res = 0;
+  int i;
+  for (i = 0; i < 24; i += 8) {
+    int a = (src >> i) & 0xff;
+    int b = (dst >> i) & 0xff;
+    int c;
+    switch (mode) {
+      default:
+      case PALETTE_BLEND_ALPHA    : c = (a + b) >> 1;   break;
+      case PALETTE_BLEND_ADD      : c = a + b;          break;
+      case PALETTE_BLEND_MULTIPLY : c = (a * b) / 255;  break;
+    }
+    res |= ((c > 0xff) ? 0xff : c) << i;
+  }
+  return res;
+}
+
+
+const unsigned char *palette_getBlendTable(int mode) {
+  /* Returns the blend table for the mode, (re)building it if the palette has
+   * changed since it was last built */
+  palette_init();
+  unsigned char *t = palette_blendTables[mode];
+  if (t && palette_blendVersions[mode] == palette_version) {
+    return t;
+  }
+  if (!t) {
+    t = palette_blendTables[mode] = dmt_malloc(MAX_IDX * MAX_IDX);
+  }
+  palette_blendVersions[mode] = palette_version;
+  int src, dst;
+  for (src = 0; src < MAX_IDX; src++) {
+    unsigned srcColor = (src < palette_nextIdx) ? palette_palette[src] : 0;
+    for (dst = 0; dst < MAX_IDX; dst++) {
+      unsigned dstColor = (dst < palette_nextIdx) ? palette_palette[dst] : 0;
+      unsigned color = blendColor(mode, srcColor, dstColor);
+      int idx = findIdx(color);
+      if (!idx) {
+        idx = palette_nearestIdx(color & 0xff, (color >> 8) & 0xff,
+                                 (color >> 16) & 0xff);
+      }
+      t[(src << 8) | dst] = (idx < 0) ? 0 : idx;
+    }
+  }
+  return t;
+}
+
+
+const unsigned char *palette_getShadeTable(void) {
+  /* Returns the shade table, (re)building it if the palette has changed since
+   * it was last built. Level 0 leaves colors unchanged, each further level
+   * darkens them by another 1/PALETTE_SHADE_LEVELS */
+  palette_init();
+  unsigned char *t = palette_shadeTable;
+  if (palette_shadeVersion == palette_version) {
+    return t;
+  }
+  palette_shadeVersion = palette_version;
+  int level, idx;
+  for (level = 0; level < PALETTE_SHADE_LEVELS; level++) {
+    int k = PALETTE_SHADE_LEVELS - level;
+    t[level << 8] = 0;
+    for (idx = 1; idx < MAX_IDX; idx++) {
+      unsigned color = (idx < palette_nextIdx) ? palette_palette[idx] : 0;
+      int r = (color & 0xff) * k / PALETTE_SHADE_LEVELS;
+      int g = ((color >> 8) & 0xff) * k / PALETTE_SHADE_LEVELS;
+      int b = ((color >> 16) & 0xff) * k / PALETTE_SHADE_LEVELS;
+      int res = findIdx(r | (g << 8) | (b << 16));
+      if (!res) {
+        res = palette_nearestIdx(r, g, b);
+      }
+      t[(level << 8) | idx] = (res < 0) ? 0 : res;
+    }
+  }
+  return t;
+}
+
+
 int palette_idxToColor(int idx, int *rgb) {
   /* Bounds check, return -1 on error */
   if (idx <= 0 || idx >= MAX_IDX) {
@@ -8,9 +8,36 @@
 #ifndef PALETTE_H
 #define PALETTE_H
 
+enum {
+  PALETTE_EXACT,
+  PALETTE_NEAREST,
+};
+
+enum {
+  PALETTE_BLEND_ALPHA,
+  PALETTE_BLEND_ADD,
+  PALETTE_BLEND_MULTIPLY,
+  PALETTE_BLEND_MAX
+};
+
+#define PALETTE_SHADE_LEVELS  16
+
 void palette_init(void);
+void palette_deinit(void);
 void palette_reset(void);
+void palette_flush(void);
+void palette_update(double dt);
+int palette_cycle(int first, int last, double speed);
+void palette_fade(double duration, const unsigned *target, const char *has);
+int palette_setColor(int idx, int r, int g, int b);
+void palette_setMode(int mode);
+int palette_getMode(void);
+int palette_getFree(void);
 int palette_colorToIdx(int r, int g, int b);
+int palette_nearestIdx(int r, int g, int b);
+int palette_compact(const char *used, unsigned char *remap);
+const unsigned char *palette_getBlendTable(int mode);
+const unsigned char *palette_getShadeTable(void);
 int palette_idxToColor(int idx, int *rgb);
 
 #endif
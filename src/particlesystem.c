@@ -0,0 +1,214 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "lib/dmt/dmt.h"
+#include "particlesystem.h"
+
+#define FX_ONE      0x10000
+#define TO_FX(x)    ((int) ((x) * FX_ONE))
+#define FX_MUL(a,b) ((int) (((long long) (a) * (b)) >> 16))
+/* Positions are clamped to this many pixels either side of the origin so that
+ * they stay within the range of 16.16 fixed point */
+#define MAX_POS     30000.
+/* Lifetimes are at least this many seconds to keep `rate` in range */
+#define MIN_LIFE    (1. / 1024)
+
+
+static double randomFloat(particlesystem_t *self) {
+  /* xorshift32, each system has its own deterministic sequence */
+  unsigned s = self->seed;
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  self->seed = s;
+  return (s >> 8) * (1. / (1 << 24));
+}
+
+
+static double randomRange(particlesystem_t *self, double min, double max) {
+  return min + (max - min) * randomFloat(self);
+}
+
+
+static int toFixedPos(double v) {
+  if (v < -MAX_POS) v = -MAX_POS;
+  if (v >  MAX_POS) v =  MAX_POS;
+  return TO_FX(v);
+}
+
+
+void particlesystem_init(particlesystem_t *self, int capacity) {
+  static unsigned seeds;
+  memset(self, 0, sizeof(*self));
+  /* All the fields are allocated as a single block */
+  int *p = dmt_malloc(capacity * 6 * sizeof(int));
+  self->x    = p;
+  self->y    = p + capacity;
+  self->vx   = p + capacity * 2;
+  self->vy   = p + capacity * 3;
+  self->age  = p + capacity * 4;
+  self->rate = p + capacity * 5;
+  self->capacity = capacity;
+  self->lifeMin = self->lifeMax = 1;
+  self->width = self->height = 1;
+  self->seed = 0x9e3779b9 ^ (++seeds * 0x85ebca6b);
+}
+
+
+void particlesystem_deinit(particlesystem_t *self) {
+  dmt_free(self->x);
+}
+
+
+void particlesystem_emit(particlesystem_t *self, int n) {
+  /* Spawns up to `n` particles at the emitter, fewer if this would exceed the
+   * system's capacity */
+  if (n > self->capacity - self->count) {
+    n = self->capacity - self->count;
+  }
+  while (n-- > 0) {
+    int i = self->count++;
+    double x = self->px, y = self->py, a, r;
+    switch (self->area) {
+      case PARTICLESYSTEM_AREA_RECTANGLE:
+        x += randomRange(self, -self->areaw, self->areaw);
+        y += randomRange(self, -self->areah, self->areah);
+        break;
+      case PARTICLESYSTEM_AREA_ELLIPSE:
+        do {
+          a = randomRange(self, -1, 1);
+          r = randomRange(self, -1, 1);
+        } while (a * a + r * r > 1);
+        x += a * self->areaw;
+        y += r * self->areah;
+        break;
+      case PARTICLESYSTEM_AREA_RING:
+        a = randomFloat(self) * M_PI * 2;
+        x += cos(a) * self->areaw;
+        y += sin(a) * self->areah;
+        break;
+    }
+    a = self->direction + self->spread * (randomFloat(self) - 0.5);
+    r = randomRange(self, self->speedMin, self->speedMax);
+    double life = randomRange(self, self->lifeMin, self->lifeMax);
+    self->x[i] = toFixedPos(x);
+    self->y[i] = toFixedPos(y);
+    self->vx[i] = toFixedPos(cos(a) * r);
+    self->vy[i] = toFixedPos(sin(a) * r);
+    self->age[i] = 0;
+    self->rate[i] = FX_ONE / (life > MIN_LIFE ? life : MIN_LIFE);
+  }
+}
+
+
+void particlesystem_update(particlesystem_t *self, double dt) {
+  /* Ages and moves every particle, removing those which have reached the end
+   * of their lifetime by moving the last particle into their place. `dt` is
+   * capped at one second to keep its fixed point products in range */
+  if (dt <= 0) {
+    return;
+  }
+  if (dt > 1) dt = 1;
+  int fdt = TO_FX(dt);
+  int dvx = toFixedPos(self->ax * dt);
+  int dvy = toFixedPos(self->ay * dt);
+  int i = 0;
+  while (i < self->count) {
+    int age = self->age[i] + FX_MUL(self->rate[i], fdt);
+    if (age >= FX_ONE) {
+      int last = --self->count;
+      self->x[i]    = self->x[last];
+      self->y[i]    = self->y[last];
+      self->vx[i]   = self->vx[last];
+      self->vy[i]   = self->vy[last];
+      self->age[i]  = self->age[last];
+      self->rate[i] = self->rate[last];
+      continue;
+    }
+    self->age[i] = age;
+    self->vx[i] += dvx;
+    self->vy[i] += dvy;
+    self->x[i] += FX_MUL(self->vx[i], fdt);
+    self->y[i] += FX_MUL(self->vy[i], fdt);
+    i++;
+  }
+
+  /* Emit new particles. No more than a full system's worth can be pending,
+   * which also keeps the count in range of an int */
+  self->emitted += self->emissionRate * dt;
+  if (self->emitted > self->capacity) {
+    self->emitted = self->capacity;
+  }
+  if (self->emitted >= 1) {
+    int n = self->emitted;
+    self->emitted -= n;
+    particlesystem_emit(self, n);
+  }
+}
+
+
+extern int image_flip;
+
+void particlesystem_draw(particlesystem_t *self, pixel_t *buf,
+                         int bufw, int bufh, int bufs,
+                         const pixel_t *colors, int dx, int dy
+) {
+  /* Draws each particle centered on its position plus `dx`, `dy`. `colors`
+   * holds the palette index of each of the system's colors; points and
+   * rectangles take their color from it based on their age and image sprites
+   * use it as the color of the `color` blend mode */
+  int i, j;
+  int n = self->ncolors;
+  int w = self->width, h = self->height;
+
+  if (self->image) {
+    image_t *img = self->image;
+    int oldFlip = image_flip;
+    image_setFlip(0);
+    dx -= self->sw / 2;
+    dy -= self->sh / 2;
+    for (i = 0; i < self->count; i++) {
+      if (n) image_setColor(colors[(self->age[i] * n) >> 16]);
+      image_blit(img, buf, bufw, bufh, bufs,
+                 (self->x[i] >> 16) + dx, (self->y[i] >> 16) + dy,
+                 self->sx, self->sy, self->sw, self->sh);
+    }
+    image_setFlip(oldFlip);
+    return;
+  }
+
+  if (w == 1 && h == 1) {
+    for (i = 0; i < self->count; i++) {
+      unsigned x = (self->x[i] >> 16) + dx;
+      unsigned y = (self->y[i] >> 16) + dy;
+      if (x < (unsigned) bufw && y < (unsigned) bufh) {
+        buf[x + y * bufs] = colors[(self->age[i] * n) >> 16];
+      }
+    }
+    return;
+  }
+
+  dx -= w / 2;
+  dy -= h / 2;
+  for (i = 0; i < self->count; i++) {
+    int x = (self->x[i] >> 16) + dx;
+    int y = (self->y[i] >> 16) + dy;
+    int x2 = x + w, y2 = y + h;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x2 > bufw) x2 = bufw;
+    if (y2 > bufh) y2 = bufh;
+    if (x >= x2 || y >= y2) continue;
+    pixel_t color = colors[(self->age[i] * n) >> 16];
+    for (j = y; j < y2; j++) {
+      memset(buf + x + j * bufs, color, x2 - x);
+    }
+  }
+}
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef PARTICLESYSTEM_H
+#define PARTICLESYSTEM_H
+
+#include "image.h"
+
+#define PARTICLESYSTEM_MAX_COLORS 16
+
+enum {
+  PARTICLESYSTEM_AREA_NONE,
+  PARTICLESYSTEM_AREA_RECTANGLE,
+  PARTICLESYSTEM_AREA_ELLIPSE,
+  PARTICLESYSTEM_AREA_RING,
+};
+
+typedef struct {
+  /* Particle state, one array per field; positions and velocities are 16.16
+   * fixed point pixels, `age` runs from 0 to 0x10000 over the particle's
+   * lifetime at `rate` per second */
+  int *x, *y, *vx, *vy, *age, *rate;
+  int count, capacity;
+  /* Emitter settings */
+  double px, py;
+  int area;
+  double areaw, areah;
+  double emissionRate, emitted;
+  double lifeMin, lifeMax;
+  double speedMin, speedMax;
+  double direction, spread;
+  double ax, ay;
+  int width, height;
+  image_t *image;
+  int sx, sy, sw, sh;
+  int colors[PARTICLESYSTEM_MAX_COLORS][3];
+  int ncolors;
+  unsigned seed;
+} particlesystem_t;
+
+void particlesystem_init(particlesystem_t *self, int capacity);
+void particlesystem_deinit(particlesystem_t *self);
+void particlesystem_emit(particlesystem_t *self, int n);
+void particlesystem_update(particlesystem_t *self, double dt);
+void particlesystem_draw(particlesystem_t *self, pixel_t *buf,
+                         int bufw, int bufh, int bufs,
+                         const pixel_t *colors, int dx, int dy);
+
+#endif
@@ -0,0 +1,30 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifdef __DJGPP__
+
+#include <dos.h>
+#include <time.h>
+
+#include "platform.h"
+
+
+const char *platform_getOS(void) {
+  return "DOS";
+}
+
+
+double platform_getTime(void) {
+  return uclock() / (double) UCLOCKS_PER_SEC;
+}
+
+
+void platform_sleep(double seconds) {
+  delay(seconds * 1000.);
+}
+
+#endif
@@ -0,0 +1,19 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+/* Operating system services used by the engine core. Like the device
+ * backends (vga.h, keyboard.h, mouse.h and soundblaster.h) these are chosen
+ * at compile time: platform.c implements them for DOS and
+ * platform_headless.c for POSIX hosts */
+const char *platform_getOS(void);
+double platform_getTime(void);
+void platform_sleep(double seconds);
+
+#endif
@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef __DJGPP__
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <time.h>
+#include <sys/utsname.h>
+
+#include "platform.h"
+
+
+const char *platform_getOS(void) {
+  static struct utsname name;
+  if (!*name.sysname && uname(&name) != 0) {
+    return "Unknown";
+  }
+  return name.sysname;
+}
+
+
+double platform_getTime(void) {
+  /* Time is counted from the first call, the same as uclock() */
+  static struct timespec start;
+  static int started = 0;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  if (!started) {
+    start = ts;
+    started = 1;
+  }
+  return (ts.tv_sec - start.tv_sec) + (ts.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+
+void platform_sleep(double seconds) {
+  struct timespec ts;
+  if (seconds <= 0) {
+    return;
+  }
+  ts.tv_sec = seconds;
+  ts.tv_nsec = (seconds - ts.tv_sec) * 1e9;
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+#endif
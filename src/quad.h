@@ -13,7 +13,7 @@
 typedef struct {
   lua_Number x, y;
   lua_Number width, height;
-} quad_t;
+} quadrect_t;
 
 
 
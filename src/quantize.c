@@ -0,0 +1,262 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/dmt/dmt.h"
+#include "quantize.h"
+#include "palette.h"
+
+#define MAX_COLORS  255
+#define CELL_COUNT  (1 << 15)
+#define CELL(r, g, b)  (((b) << 10) | ((g) << 5) | (r))
+
+/* Squared distance under which a box's color reuses an existing palette entry
+ * rather than taking a new slot -- this is about the size of a 15bit cell */
+#define REUSE_DIST  (3 * 8 * 8)
+
+typedef struct {
+  int min[3], max[3];
+  unsigned count;
+} box_t;
+
+
+static const int bayer[4][4] = {
+  {  0,  8,  2, 10 },
+  { 12,  4, 14,  6 },
+  {  3, 11,  1,  9 },
+  { 15,  7, 13,  5 },
+};
+
+
+static void shrinkBox(box_t *box, const unsigned *hist) {
+  /* Shrinks the box to the bounds of the non-empty cells inside it and
+   * recounts its population */
+  int r, g, b;
+  int min[3] = { 31, 31, 31 };
+  int max[3] = { 0, 0, 0 };
+  box->count = 0;
+  for (b = box->min[2]; b <= box->max[2]; b++) {
+    for (g = box->min[1]; g <= box->max[1]; g++) {
+      for (r = box->min[0]; r <= box->max[0]; r++) {
+        unsigned n = hist[CELL(r, g, b)];
+        if (n) {
+          if (r < min[0]) min[0] = r;
+          if (r > max[0]) max[0] = r;
+          if (g < min[1]) min[1] = g;
+          if (g > max[1]) max[1] = g;
+          if (b < min[2]) min[2] = b;
+          if (b > max[2]) max[2] = b;
+          box->count += n;
+        }
+      }
+    }
+  }
+  if (box->count) {
+    memcpy(box->min, min, sizeof(min));
+    memcpy(box->max, max, sizeof(max));
+  }
+}
+
+
+static void splitBox(box_t *box, box_t *out, const unsigned *hist) {
+  /* Splits the box at the population median of its longest axis, the upper
+   * half is stored in `out` */
+  int i, axis = 0;
+  for (i = 1; i < 3; i++) {
+    if (box->max[i] - box->min[i] > box->max[axis] - box->min[axis]) {
+      axis = i;
+    }
+  }
+
+  /* Count population of each plane along the axis */
+  unsigned planes[32];
+  int p[3];
+  memset(planes, 0, sizeof(planes));
+  for (p[2] = box->min[2]; p[2] <= box->max[2]; p[2]++) {
+    for (p[1] = box->min[1]; p[1] <= box->max[1]; p[1]++) {
+      for (p[0] = box->min[0]; p[0] <= box->max[0]; p[0]++) {
+        planes[p[axis]] += hist[CELL(p[0], p[1], p[2])];
+      }
+    }
+  }
+
+  /* Find the median plane, leaving at least one plane for the upper half */
+  unsigned acc = 0;
+  int cut;
+  for (cut = box->min[axis]; cut < box->max[axis] - 1; cut++) {
+    acc += planes[cut];
+    if (acc * 2 >= box->count) break;
+  }
+
+  *out = *box;
+  box->max[axis] = cut;
+  out->min[axis] = cut + 1;
+  shrinkBox(box, hist);
+  shrinkBox(out, hist);
+}
+
+
+static int medianCut(box_t *boxes, int maxBoxes, const unsigned *hist) {
+  /* Fills `boxes` with up to `maxBoxes` boxes, always splitting the most
+   * populated box which still spans more than one cell. Returns the number of
+   * boxes */
+  int i, n = 1;
+  boxes[0].min[0] = boxes[0].min[1] = boxes[0].min[2] = 0;
+  boxes[0].max[0] = boxes[0].max[1] = boxes[0].max[2] = 31;
+  shrinkBox(&boxes[0], hist);
+  if (boxes[0].count == 0) {
+    return 0;
+  }
+  while (n < maxBoxes) {
+    box_t *best = NULL;
+    for (i = 0; i < n; i++) {
+      box_t *b = &boxes[i];
+      if (b->min[0] == b->max[0] && b->min[1] == b->max[1] &&
+          b->min[2] == b->max[2]) {
+        continue;
+      }
+      if (!best || b->count > best->count) {
+        best = b;
+      }
+    }
+    if (!best) break;
+    splitBox(best, &boxes[n++], hist);
+  }
+  return n;
+}
+
+
+const char *quantize_image(pixel_t *dst, const unsigned char *data32,
+                           int width, int height, int colors, int dither
+) {
+  /* Converts the 32bit image data to 8bit paletted, first reducing the
+   * image's colors to at most `colors` new palette entries using median cut.
+   * Pixels are then converted through a table indexed by their 15bit color,
+   * optionally with ordered dithering */
+  int i, x, y, r, g, b;
+  int sz = width * height;
+  int opaque = 0;
+  const char *errmsg = NULL;
+  unsigned *hist = dmt_calloc(CELL_COUNT, sizeof(*hist));
+  unsigned char *cellBox = dmt_calloc(CELL_COUNT, 1);
+  pixel_t *lut = dmt_malloc(CELL_COUNT);
+
+  /* Build histogram of opaque pixels */
+  for (i = 0; i < sz; i++) {
+    const unsigned char *p = data32 + i * 4;
+    if (p[3] >= 127) {
+      hist[CELL(p[0] >> 3, p[1] >> 3, p[2] >> 3)]++;
+      opaque++;
+    }
+  }
+
+  /* Reduce to boxes, never asking for more than the free palette slots */
+  box_t boxes[MAX_COLORS];
+  int maxBoxes = palette_getFree();
+  if (colors < maxBoxes) maxBoxes = colors;
+  if (maxBoxes > MAX_COLORS) maxBoxes = MAX_COLORS;
+  int nboxes = (maxBoxes > 0) ? medianCut(boxes, maxBoxes, hist) : 0;
+
+  /* Mark each cell with its box (+1, 0 being no box) */
+  for (i = 0; i < nboxes; i++) {
+    box_t *box = &boxes[i];
+    for (b = box->min[2]; b <= box->max[2]; b++) {
+      for (g = box->min[1]; g <= box->max[1]; g++) {
+        for (r = box->min[0]; r <= box->max[0]; r++) {
+          cellBox[CELL(r, g, b)] = i + 1;
+        }
+      }
+    }
+  }
+
+  /* Average the true colors of each box's pixels */
+  unsigned sums[MAX_COLORS][4];
+  memset(sums, 0, sizeof(sums));
+  for (i = 0; i < sz; i++) {
+    const unsigned char *p = data32 + i * 4;
+    int box = cellBox[CELL(p[0] >> 3, p[1] >> 3, p[2] >> 3)];
+    if (p[3] >= 127 && box) {
+      unsigned *s = sums[box - 1];
+      s[0] += p[0];
+      s[1] += p[1];
+      s[2] += p[2];
+      s[3]++;
+    }
+  }
+
+  /* Get a palette idx for each box, reusing a close enough existing color
+   * where possible. Taking a new slot only fails in the "exact" palette mode,
+   * the "nearest" mode falls back to the nearest color itself */
+  int boxIdx[MAX_COLORS];
+  for (i = 0; i < nboxes; i++) {
+    unsigned *s = sums[i];
+    int c[3] = { s[0] / s[3], s[1] / s[3], s[2] / s[3] };
+    int rgb[3];
+    int idx = palette_nearestIdx(c[0], c[1], c[2]);
+    if (idx > 0 && palette_idxToColor(idx, rgb) == 0) {
+      int dr = rgb[0] - c[0], dg = rgb[1] - c[1], db = rgb[2] - c[2];
+      if (dr * dr + dg * dg + db * db > REUSE_DIST) {
+        idx = -1;
+      }
+    }
+    if (idx <= 0) {
+      idx = palette_colorToIdx(c[0], c[1], c[2]);
+    }
+    if (idx < 0) {
+      errmsg = "color palette exhausted: use fewer unique colors";
+      goto done;
+    }
+    boxIdx[i] = idx;
+  }
+
+  /* Build cell lookup table; cells outside of all boxes (reachable when
+   * dithering or if the palette had no free slots) use the nearest palette
+   * color, of which there must be one if any pixel is opaque */
+  if (nboxes == 0 && opaque && palette_nearestIdx(0, 0, 0) < 0) {
+    errmsg = "color palette exhausted: use fewer unique colors";
+    goto done;
+  }
+  for (i = 0; i < CELL_COUNT; i++) {
+    if (cellBox[i]) {
+      lut[i] = boxIdx[cellBox[i] - 1];
+    } else if (dither || hist[i]) {
+      int idx = palette_nearestIdx((i & 31) << 3, ((i >> 5) & 31) << 3,
+                                   ((i >> 10) & 31) << 3);
+      lut[i] = (idx < 0) ? 0 : idx;
+    }
+  }
+
+  /* Convert pixels */
+  i = 0;
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < width; x++, i++) {
+      const unsigned char *p = data32 + i * 4;
+      if (p[3] < 127) {
+        dst[i] = 0;
+        continue;
+      }
+      r = p[0];
+      g = p[1];
+      b = p[2];
+      if (dither) {
+        int d = bayer[y & 3][x & 3] * 2 - 15;
+        r += d; r = (r < 0) ? 0 : (r > 255) ? 255 : r;
+        g += d; g = (g < 0) ? 0 : (g > 255) ? 255 : g;
+        b += d; b = (b < 0) ? 0 : (b > 255) ? 255 : b;
+      }
+      dst[i] = lut[CELL(r >> 3, g >> 3, b >> 3)];
+    }
+  }
+
+done:
+  dmt_free(hist);
+  dmt_free(cellBox);
+  dmt_free(lut);
+  return errmsg;
+}
@@ -0,0 +1,16 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include "vga.h"
+
+const char *quantize_image(pixel_t *dst, const unsigned char *data32,
+                           int width, int height, int colors, int dither);
+
+#endif
@@ -0,0 +1,133 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <math.h>
+
+#include "raycast.h"
+#include "palette.h"
+
+pixel_t raycast_identity[256];
+int raycast_inited;
+
+
+static void drawColumn(pixel_t *buf, int bufh, int bufs, int col,
+                       image_t *tex, int tx, double top, double height,
+                       const pixel_t *shade
+) {
+  /* Draws texture column `tx` stretched to `height` pixels starting at row
+   * `top`, passing each pixel through the `shade` table */
+  int y0 = ceil(top - 0.5);
+  int y1 = ceil(top + height - 0.5);
+  if (y0 < 0) y0 = 0;
+  if (y1 > bufh) y1 = bufh;
+  if (y0 >= y1) return;
+  int th = tex->height;
+  int step = th / height * 65536.;
+  int v = (y0 + 0.5 - top) * th / height * 65536.;
+  pixel_t *d = buf + col + y0 * bufs;
+  const pixel_t *data = tex->data + tx;
+  const pixel_t *mask = tex->mask + tx;
+  int y;
+  for (y = y0; y < y1; y++) {
+    int ty = v >> 16;
+    if (ty >= th) ty = th - 1;
+    ty *= tex->stride;
+    if (!mask[ty]) *d = shade[data[ty]];
+    d += bufs;
+    v += step;
+  }
+}
+
+
+void raycast_render(pixel_t *buf, int bufw, int bufh, int bufs,
+                    const unsigned char *map, int mapw, int maph,
+                    image_t **textures, int ntextures,
+                    double x, double y, double angle, double fov,
+                    double shade, double *zbuf
+) {
+  /* Casts a ray through the grid `map` for each column of the buffer from the
+   * position `x`, `y` (in cells) facing `angle`, stepping from cell edge to
+   * cell edge until a cell with a texture is hit. Each hit wall is drawn as a
+   * textured column 1 cell tall, darkened with distance if `shade` is not 0.
+   * The perpendicular distance of each column's wall is written to `zbuf`, or
+   * HUGE_VAL if the ray left the map */
+  int col;
+  if (!raycast_inited) {
+    for (col = 0; col < 256; col++) raycast_identity[col] = col;
+    raycast_inited = 1;
+  }
+  const pixel_t *shades = (shade > 0) ? palette_getShadeTable() : NULL;
+  double dirx = cos(angle), diry = sin(angle);
+  double t = tan(fov / 2);
+  double planex = -diry * t, planey = dirx * t;
+  double focal = bufw / 2. / t;
+
+  for (col = 0; col < bufw; col++) {
+    /* Init ray */
+    double camx = 2. * (col + 0.5) / bufw - 1;
+    double rx = dirx + planex * camx;
+    double ry = diry + planey * camx;
+    int mx = floor(x), my = floor(y);
+    double ddx = (rx == 0) ? 1e30 : fabs(1 / rx);
+    double ddy = (ry == 0) ? 1e30 : fabs(1 / ry);
+    int stepx = (rx < 0) ? -1 : 1;
+    int stepy = (ry < 0) ? -1 : 1;
+    double sdx = ((rx < 0) ? x - mx : mx + 1 - x) * ddx;
+    double sdy = ((ry < 0) ? y - my : my + 1 - y) * ddy;
+
+    /* Step through cells until a wall is hit or the ray leaves the map */
+    int side = 0, cell = 0;
+    for (;;) {
+      if (sdx < sdy) {
+        sdx += ddx;
+        mx += stepx;
+        side = 0;
+      } else {
+        sdy += ddy;
+        my += stepy;
+        side = 1;
+      }
+      if (mx < 0 || my < 0 || mx >= mapw || my >= maph) {
+        cell = 0;
+        break;
+      }
+      cell = map[mx + my * mapw];
+      if (cell && cell <= ntextures) break;
+    }
+    if (!cell) {
+      zbuf[col] = HUGE_VAL;
+      continue;
+    }
+
+    /* Get distance and texture column */
+    double dist = side ? sdy - ddy : sdx - ddx;
+    if (dist < 1e-4) dist = 1e-4;
+    zbuf[col] = dist;
+    double wallx = side ? x + dist * rx : y + dist * ry;
+    wallx -= floor(wallx);
+    image_t *tex = textures[cell - 1];
+    int tx = wallx * tex->width;
+    /* `wallx` can round up to 1 */
+    if (tx < 0) tx = 0;
+    if (tx >= tex->width) tx = tex->width - 1;
+    if ((side == 0 && rx > 0) || (side == 1 && ry < 0)) {
+      tx = tex->width - tx - 1;
+    }
+
+    /* Get shade level; walls facing along the y axis are a level darker */
+    const pixel_t *tab = raycast_identity;
+    if (shades) {
+      int level = dist / shade * PALETTE_SHADE_LEVELS + side;
+      if (level >= PALETTE_SHADE_LEVELS) level = PALETTE_SHADE_LEVELS - 1;
+      tab = shades + (level << 8);
+    }
+
+    double height = focal / dist;
+    drawColumn(buf, bufh, bufs, col, tex, tx, (bufh - height) / 2, height,
+               tab);
+  }
+}
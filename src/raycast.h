@@ -0,0 +1,19 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef RAYCAST_H
+#define RAYCAST_H
+
+#include "image.h"
+
+void raycast_render(pixel_t *buf, int bufw, int bufh, int bufs,
+                    const unsigned char *map, int mapw, int maph,
+                    image_t **textures, int ntextures,
+                    double x, double y, double angle, double fov,
+                    double shade, double *zbuf);
+
+#endif
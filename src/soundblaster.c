@@ -5,6 +5,8 @@
  * under the terms of the MIT license. See LICENSE for details.
  */
 
+#ifdef __DJGPP__
+
 #include <time.h>
 #include <stdlib.h>
 #include <string.h>
@@ -406,3 +408,5 @@ int soundblaster_getSampleRate(void) {
 int soundblaster_getSampleBufferSize(void) {
   return SOUNDBLASTER_SAMPLES_PER_BUFFER;
 }
+
+#endif
@@ -0,0 +1,36 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef __DJGPP__
+
+#include "soundblaster.h"
+
+/* Headless audio backend for host builds: there is no sound card, so the
+ * sample callback is never called and nothing is played */
+
+#define SAMPLE_RATE 22050
+
+
+int soundblaster_init(soundblaster_getSampleProc sampleproc) {
+  return 0;
+}
+
+
+void soundblaster_deinit(void) {
+}
+
+
+int soundblaster_getSampleRate(void) {
+  return SAMPLE_RATE;
+}
+
+
+int soundblaster_getSampleBufferSize(void) {
+  return SOUNDBLASTER_SAMPLES_PER_BUFFER;
+}
+
+#endif
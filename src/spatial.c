@@ -0,0 +1,271 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "lib/dmt/dmt.h"
+#include "spatial.h"
+
+/* Items spanning more cells than this are kept in a separate list which is
+ * checked by every query rather than being added to each of their cells */
+#define MAX_SPAN    64
+#define MIN_BUCKETS 64
+#define MAX_CELL    (1 << 24)
+
+
+static int toCell(spatial_t *self, float v) {
+  double c = floor(v * self->invCellSize);
+  if (!(c >= -MAX_CELL)) return -MAX_CELL;
+  if (c >  MAX_CELL) return  MAX_CELL;
+  return c;
+}
+
+
+static unsigned hash(int cx, int cy) {
+  return ((unsigned) cx * 73856093u) ^ ((unsigned) cy * 19349663u);
+}
+
+
+static void setRange(spatial_t *self, spatial_item_t *it) {
+  it->cx0 = toCell(self, it->x);
+  it->cy0 = toCell(self, it->y);
+  it->cx1 = toCell(self, it->x + it->w);
+  it->cy1 = toCell(self, it->y + it->h);
+}
+
+
+static int isLarge(spatial_item_t *it) {
+  return (double) (it->cx1 - it->cx0 + 1) * (it->cy1 - it->cy0 + 1) > MAX_SPAN;
+}
+
+
+static void rebuild(spatial_t *self) {
+  /* Rebuilds the grid as a counting sort of each item's cells by bucket: the
+   * items in bucket `b` are `cells[buckets[b]]` to `cells[buckets[b + 1]]` */
+  int i, cx, cy, total = 0;
+  int nb = MIN_BUCKETS;
+  while (nb < self->count * 2) nb <<= 1;
+  if (nb != self->nbuckets) {
+    self->nbuckets = nb;
+    self->buckets = dmt_realloc(self->buckets, (nb + 1) * sizeof(int));
+  }
+  unsigned mask = nb - 1;
+  int *b = self->buckets;
+  memset(b, 0, (nb + 1) * sizeof(int));
+  self->nlarge = 0;
+
+  /* Count */
+  for (i = 0; i < self->count; i++) {
+    spatial_item_t *it = &self->items[i];
+    if (isLarge(it)) {
+      self->large[self->nlarge++] = i;
+      continue;
+    }
+    for (cy = it->cy0; cy <= it->cy1; cy++) {
+      for (cx = it->cx0; cx <= it->cx1; cx++) {
+        b[hash(cx, cy) & mask]++;
+      }
+    }
+  }
+  for (i = 0; i < nb; i++) {
+    total += b[i];
+    b[i] = total;
+  }
+  b[nb] = total;
+  if (total > self->cellCapacity) {
+    self->cellCapacity = total;
+    self->cells = dmt_realloc(self->cells, total * sizeof(int));
+  }
+
+  /* Scatter, leaving each bucket's offset as its start */
+  for (i = 0; i < self->count; i++) {
+    spatial_item_t *it = &self->items[i];
+    if (isLarge(it)) continue;
+    for (cy = it->cy0; cy <= it->cy1; cy++) {
+      for (cx = it->cx0; cx <= it->cx1; cx++) {
+        self->cells[--b[hash(cx, cy) & mask]] = i;
+      }
+    }
+  }
+  self->dirty = 0;
+}
+
+
+void spatial_init(spatial_t *self, float cellSize) {
+  memset(self, 0, sizeof(*self));
+  self->cellSize = cellSize;
+  self->invCellSize = 1. / cellSize;
+  self->dirty = 1;
+}
+
+
+void spatial_deinit(spatial_t *self) {
+  dmt_free(self->items);
+  dmt_free(self->slots);
+  dmt_free(self->buckets);
+  dmt_free(self->cells);
+  dmt_free(self->large);
+  dmt_free(self->marks);
+  dmt_free(self->results);
+}
+
+
+void spatial_clear(spatial_t *self) {
+  int i;
+  for (i = 0; i < self->count; i++) {
+    self->slots[self->items[i].id] = 0;
+  }
+  self->count = 0;
+  self->dirty = 1;
+}
+
+
+spatial_item_t *spatial_get(spatial_t *self, int id) {
+  if (id < 0 || id >= self->nslots || !self->slots[id]) {
+    return NULL;
+  }
+  return &self->items[self->slots[id] - 1];
+}
+
+
+void spatial_insert(spatial_t *self, int id,
+                    float x, float y, float w, float h
+) {
+  /* Adds the item or replaces its rect if it already exists. `id` must be
+   * between 0 and SPATIAL_MAX_ID; `slots` maps each id to its item's index
+   * plus one so that any item can be found, moved or removed in O(1) */
+  if (spatial_move(self, id, x, y, w, h) == 0) {
+    return;
+  }
+  if (id >= self->nslots) {
+    int n = self->nslots ? self->nslots : 64;
+    while (n <= id) n <<= 1;
+    self->slots = dmt_realloc(self->slots, n * sizeof(int));
+    memset(self->slots + self->nslots, 0, (n - self->nslots) * sizeof(int));
+    self->nslots = n;
+  }
+  if (self->count == self->capacity) {
+    int n = self->capacity = self->capacity ? self->capacity * 2 : 64;
+    self->items = dmt_realloc(self->items, n * sizeof(*self->items));
+    self->large = dmt_realloc(self->large, n * sizeof(*self->large));
+    self->marks = dmt_realloc(self->marks, n * sizeof(*self->marks));
+    self->results = dmt_realloc(self->results, n * sizeof(*self->results));
+    memset(self->marks, 0, n * sizeof(*self->marks));
+    self->mark = 0;
+  }
+  spatial_item_t *it = &self->items[self->count++];
+  it->id = id;
+  it->x = x;
+  it->y = y;
+  it->w = w;
+  it->h = h;
+  setRange(self, it);
+  self->slots[id] = self->count;
+  self->dirty = 1;
+}
+
+
+int spatial_move(spatial_t *self, int id, float x, float y, float w, float h) {
+  /* Returns -1 if the item does not exist. The grid stores item indices and
+   * queries test against the items' current rects, so the grid is only
+   * rebuilt if the item has moved into a different set of cells */
+  spatial_item_t *it = spatial_get(self, id);
+  if (!it) {
+    return -1;
+  }
+  int cx0 = it->cx0, cy0 = it->cy0, cx1 = it->cx1, cy1 = it->cy1;
+  it->x = x;
+  it->y = y;
+  it->w = w;
+  it->h = h;
+  setRange(self, it);
+  if (it->cx0 != cx0 || it->cy0 != cy0 || it->cx1 != cx1 || it->cy1 != cy1) {
+    self->dirty = 1;
+  }
+  return 0;
+}
+
+
+int spatial_remove(spatial_t *self, int id) {
+  /* Returns -1 if the item does not exist. The last item is moved into the
+   * removed item's place to keep the items packed */
+  spatial_item_t *it = spatial_get(self, id);
+  if (!it) {
+    return -1;
+  }
+  int idx = self->slots[id] - 1;
+  self->slots[id] = 0;
+  self->count--;
+  if (idx != self->count) {
+    *it = self->items[self->count];
+    self->slots[it->id] = idx + 1;
+  }
+  self->dirty = 1;
+  return 0;
+}
+
+
+int spatial_query(spatial_t *self, float x, float y, float w, float h,
+                  const int **results
+) {
+  /* Sets `results` to the ids of the items whose rects overlap or touch the
+   * given rect and returns their count. The results are only valid until the
+   * hash is next changed or queried */
+  int i, j, cx, cy, n = 0;
+  float x2 = x + w, y2 = y + h;
+  *results = self->results;
+  if (self->count == 0) {
+    return 0;
+  }
+  if (self->dirty) {
+    rebuild(self);
+  }
+
+  /* Marks stop items spanning several of the queried cells from being tested
+   * more than once; they are reset when the counter wraps */
+  if (++self->mark == 0) {
+    memset(self->marks, 0, self->capacity * sizeof(*self->marks));
+    self->mark = 1;
+  }
+  unsigned mark = self->mark;
+
+#define TEST(idx)                                                   \
+  {                                                                 \
+    int k = (idx);                                                  \
+    spatial_item_t *it = &self->items[k];                           \
+    if (self->marks[k] != mark) {                                   \
+      self->marks[k] = mark;                                        \
+      if (it->x <= x2 && x <= it->x + it->w &&                      \
+          it->y <= y2 && y <= it->y + it->h) {                      \
+        self->results[n++] = it->id;                                \
+      }                                                             \
+    }                                                               \
+  }
+
+  int cx0 = toCell(self, x), cy0 = toCell(self, y);
+  int cx1 = toCell(self, x2), cy1 = toCell(self, y2);
+  if ((double) (cx1 - cx0 + 1) * (cy1 - cy0 + 1) > self->count) {
+    /* Querying the cells would cost more than testing every item */
+    for (i = 0; i < self->count; i++) TEST(i);
+    return n;
+  }
+  unsigned mask = self->nbuckets - 1;
+  for (cy = cy0; cy <= cy1; cy++) {
+    for (cx = cx0; cx <= cx1; cx++) {
+      unsigned b = hash(cx, cy) & mask;
+      for (j = self->buckets[b]; j < self->buckets[b + 1]; j++) {
+        TEST(self->cells[j]);
+      }
+    }
+  }
+  for (i = 0; i < self->nlarge; i++) TEST(self->large[i]);
+
+#undef TEST
+
+  return n;
+}
@@ -0,0 +1,44 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#define SPATIAL_MAX_ID  (1 << 24)
+
+typedef struct {
+  float x, y, w, h;
+  int id;
+  int cx0, cy0, cx1, cy1;
+} spatial_item_t;
+
+typedef struct {
+  float cellSize, invCellSize;
+  spatial_item_t *items;
+  int count, capacity;
+  int *slots;
+  int nslots;
+  int dirty;
+  int *buckets, nbuckets;
+  int *cells, cellCapacity;
+  int *large, nlarge;
+  unsigned *marks, mark;
+  int *results;
+} spatial_t;
+
+void spatial_init(spatial_t *self, float cellSize);
+void spatial_deinit(spatial_t *self);
+void spatial_clear(spatial_t *self);
+void spatial_insert(spatial_t *self, int id,
+                    float x, float y, float w, float h);
+int spatial_move(spatial_t *self, int id, float x, float y, float w, float h);
+int spatial_remove(spatial_t *self, int id);
+spatial_item_t *spatial_get(spatial_t *self, int id);
+int spatial_query(spatial_t *self, float x, float y, float w, float h,
+                  const int **results);
+
+#endif
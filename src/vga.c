@@ -5,10 +5,13 @@
  * under the terms of the MIT license. See LICENSE for details.
  */
 
+#ifdef __DJGPP__
+
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <dos.h>
+#include <pc.h>
 #include <sys/movedata.h>
 
 #include "vga.h"
@@ -42,6 +45,24 @@ void vga_setPalette(int idx, int r, int g, int b) {
 }
 
 
+void vga_setPaletteRange(int idx, int count, const unsigned *colors) {
+  /* Sets `count` palette entries starting at `idx` from 24bit colors stored
+   * as 0xbbggrr. Waits for vertical retrace so the change is not visible
+   * mid-frame, the DAC's write index auto-increments after each color */
+  int i;
+  while (!(inportb(0x03da) & 8));
+  outp(0x03c8, idx);
+  for (i = 0; i < count; i++) {
+    unsigned color = colors[i];
+    outp(0x03c9, (color >>  2) & 0x3f);
+    outp(0x03c9, (color >> 10) & 0x3f);
+    outp(0x03c9, (color >> 18) & 0x3f);
+  }
+}
+
+
 void vga_update(pixel_t *buffer) {
   dosmemput(buffer, VGA_WIDTH * VGA_HEIGHT, 0xa0000);
 }
+
+#endif
@@ -13,9 +13,21 @@
 
 typedef unsigned char pixel_t;
 
+/* The video backend: vga.c drives VGA mode 13h under DOS, vga_headless.c
+ * keeps the frame and palette in memory for host builds. The backend is
+ * chosen at compile time, only one of the two is built for a given target */
 void vga_init(void);
 void vga_deinit(void);
 void vga_setPalette(int idx, int r, int g, int b);
+void vga_setPaletteRange(int idx, int count, const unsigned *colors);
 void vga_update(pixel_t *buffer);
 
+#ifndef __DJGPP__
+/* Headless only: the last presented frame, the palette as 0xbbggrr colors and
+ * the number of frames presented so far */
+const pixel_t *vga_getFrame(void);
+const unsigned *vga_getPalette(void);
+int vga_getFrameCount(void);
+#endif
+
 #endif
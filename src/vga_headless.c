@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) 2017 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef __DJGPP__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vga.h"
+
+/* Headless video backend for host builds: nothing is displayed, the last
+ * presented frame and the palette are kept in memory instead and can be read
+ * back with vga_getFrame() and vga_getPalette(). If the LOVEDOS_FRAMES
+ * environment variable is set each presented frame is also written as a PPM
+ * file named after it, eg. LOVEDOS_FRAMES=out/f writes out/f00000.ppm,
+ * out/f00001.ppm... */
+
+int vga_inited = 0;
+
+static pixel_t vga_frame[VGA_WIDTH * VGA_HEIGHT];
+static unsigned vga_palette[256];
+static int vga_frameCount;
+static const char *vga_framePrefix;
+
+
+void vga_init(void) {
+  if (vga_inited) return;
+  vga_inited = 1;
+  memset(vga_frame, 0, sizeof(vga_frame));
+  memset(vga_palette, 0, sizeof(vga_palette));
+  vga_frameCount = 0;
+  vga_framePrefix = getenv("LOVEDOS_FRAMES");
+}
+
+
+void vga_deinit(void) {
+  vga_inited = 0;
+}
+
+
+void vga_setPalette(int idx, int r, int g, int b) {
+  vga_palette[idx & 0xff] =
+    ((b & 0xff) << 16) | ((g & 0xff) << 8) | (r & 0xff);
+}
+
+
+void vga_setPaletteRange(int idx, int count, const unsigned *colors) {
+  /* Colors are stored as 0xbbggrr, the same as they are passed in */
+  int i;
+  for (i = 0; i < count && idx + i < 256; i++) {
+    vga_palette[idx + i] = colors[i] & 0xffffff;
+  }
+}
+
+
+static void writeFrame(void) {
+  const pixel_t *frame = vga_getFrame();
+  const unsigned *palette = vga_getPalette();
+  char filename[1024];
+  snprintf(filename, sizeof(filename), "%s%05d.ppm",
+           vga_framePrefix, vga_getFrameCount());
+  FILE *fp = fopen(filename, "wb");
+  if (!fp) return;
+  fprintf(fp, "P6\n%d %d\n255\n", VGA_WIDTH, VGA_HEIGHT);
+  int i;
+  for (i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) {
+    unsigned color = palette[frame[i]];
+    fputc(color & 0xff, fp);
+    fputc((color >> 8) & 0xff, fp);
+    fputc((color >> 16) & 0xff, fp);
+  }
+  fclose(fp);
+}
+
+
+void vga_update(pixel_t *buffer) {
+  memcpy(vga_frame, buffer, sizeof(vga_frame));
+  if (vga_framePrefix) {
+    writeFrame();
+  }
+  vga_frameCount++;
+}
+
+
+const pixel_t *vga_getFrame(void) {
+  return vga_frame;
+}
+
+
+const unsigned *vga_getPalette(void) {
+  return vga_palette;
+}
+
+
+int vga_getFrameCount(void) {
+  return vga_frameCount;
+}
+
+#endif